@@ -1,14 +1,48 @@
 // Copyright 2022, Roberto De Ioris.
 
 #include "UnrealSTLFunctionLibrary.h"
+#include "UnrealSTLAssetUserData.h"
+#include "Async/ParallelFor.h"
 #include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/SecureHash.h"
+#include "HAL/FileManager.h"
+#include "HAL/ThreadSingleton.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "GameFramework/Actor.h"
+#include "Engine/Engine.h"
+#include "EngineUtils.h"
+#include "RenderingThread.h"
 #include "StaticMeshResources.h"
 
+THIRD_PARTY_INCLUDES_START
+#include "zlib.h"
+THIRD_PARTY_INCLUDES_END
+
+DEFINE_LOG_CATEGORY_STATIC(LogUnrealSTL, Log, All);
+
 namespace UnrealSTL
 {
 	constexpr int32 BinaryHeaderSize = 80;
 	constexpr int32 BinaryHeaderSizeAndSize = BinaryHeaderSize + 4;
 	constexpr int32 BinaryTriangleSize = 50;
+	// size of the blocks read from files and of the decompressed blocks fed to the parser
+	constexpr int32 StreamBlockSize = 256 * 1024;
+	// triangles of a scene export processed by a single task
+	constexpr uint32 ExportTaskTrianglesNum = 64 * 1024;
+	// triangles of a scene export buffered before being written
+	constexpr uint32 ExportBatchTrianglesNum = 1024 * 1024;
+	// triangles preallocated when the size of the data is not known in advance
+	constexpr int64 MaxReservedTrianglesNum = 1024 * 1024;
+	// facet normal, outer loop, 3 vertices, endloop, endfacet
+	constexpr int32 ASCIILinesPerTriangle = 7;
+
+	// the bool overloads of SetNum()/Pop() are deprecated since EAllowShrinking was introduced
+#if ENGINE_MAJOR_VERSION > 5 || (ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 4)
+	constexpr EAllowShrinking NoShrinking = EAllowShrinking::No;
+#else
+	constexpr bool NoShrinking = false;
+#endif
 
 #if ENGINE_MAJOR_VERSION > 4
 	template<typename ReturnType, typename RHIResource>
@@ -38,218 +72,1532 @@ namespace UnrealSTL
 		FGenericPlatformProcess::ReturnSynchEventToPool(GPUEvent);
 	}
 #endif
-}
 
-FUnrealSTLMesh::FUnrealSTLMesh()
-{
-	TrianglesNum = 0;
-}
+	// same naming rules of the editor importer (ObjectTools::SanitizeObjectName is not available at runtime)
+	static FString GetAssetNameFromFilename(const FString& Filename)
+	{
+		FString AssetName = FPaths::GetBaseFilename(Filename);
+		for (const TCHAR* InvalidChar = INVALID_OBJECTNAME_CHARACTERS; *InvalidChar; InvalidChar++)
+		{
+			AssetName.ReplaceCharInline(*InvalidChar, TEXT('_'), ESearchCase::CaseSensitive);
+		}
+		return AssetName;
+	}
 
-FUnrealSTLMesh::FUnrealSTLMesh(const TArray<FUnrealSTLMesh>& Meshes) : FUnrealSTLMesh()
-{
-	FBox BoundingBox;
-	BoundingBox.Init();
+	// streams the file in blocks
+	static bool HashFile(const FString& Filename, FSHAHash& Hash)
+	{
+		TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*Filename));
+		if (!Reader)
+		{
+			return false;
+		}
+
+		FSHA1 HashState;
+		TArray<uint8> Block;
+		Block.SetNumUninitialized(StreamBlockSize);
+		while (Reader->Tell() < Reader->TotalSize())
+		{
+			const int64 ReadSize = FMath::Min<int64>(Reader->TotalSize() - Reader->Tell(), StreamBlockSize);
+			Reader->Serialize(Block.GetData(), ReadSize);
+			if (Reader->IsError())
+			{
+				return false;
+			}
+			HashState.Update(Block.GetData(), ReadSize);
+		}
+		HashState.Final();
+		HashState.GetHash(Hash.Hash);
+
+		return true;
+	}
 
-	for (const FUnrealSTLMesh& Mesh : Meshes)
+	// the parsing options that change the generated geometry
+	static bool IsSameConfig(const FUnrealSTLConfig& Config, const FUnrealSTLConfig& OtherConfig)
 	{
-		Vertices += Mesh.Vertices;
-		TrianglesNum += Mesh.TrianglesNum;
-		BoundingBox += Mesh.Bounds.GetBox();
+		return Config.Transform.Equals(OtherConfig.Transform) && Config.FileMode == OtherConfig.FileMode && Config.bReverseWinding == OtherConfig.bReverseWinding &&
+			Config.bCleanupFacets == OtherConfig.bCleanupFacets && Config.Material == OtherConfig.Material;
 	}
 
-	BoundingBox.GetCenterAndExtents(Bounds.Origin, Bounds.BoxExtent);
-	Bounds.SphereRadius = 0;
-	uint32 VertexBase = 0;
-	for (const FUnrealSTLMesh& Mesh : Meshes)
+	// the asset is used only if it has been imported from the same content with the same config
+	static UStaticMesh* LoadCookedStaticMesh(const FUnrealSTLFile& File, const FUnrealSTLStaticMeshConfig& StaticMeshConfig)
 	{
-		FStaticMeshSection Section;
-		Section.FirstIndex = LODIndices.Num();
-		Section.NumTriangles = Mesh.TrianglesNum;
-		Sections.Add(Section);
-		for (const FStaticMeshBuildVertex& BuildVertex : Mesh.Vertices)
+		// cooked assets are shared, a custom Outer requires a new StaticMesh
+		if (StaticMeshConfig.Outer)
+		{
+			return nullptr;
+		}
+
+		const FString AssetName = GetAssetNameFromFilename(File.Filename);
+		const FString PackageName = StaticMeshConfig.CookedContentPath / AssetName;
+		if (!FPackageName::IsValidLongPackageName(PackageName) || !FPackageName::DoesPackageExist(PackageName))
+		{
+			return nullptr;
+		}
+
+		UStaticMesh* StaticMesh = LoadObject<UStaticMesh>(nullptr, *FString::Printf(TEXT("%s.%s"), *PackageName, *AssetName), nullptr, LOAD_NoWarn | LOAD_Quiet);
+		if (!StaticMesh || (StaticMeshConfig.bAllowCPUAccess && !StaticMesh->bAllowCPUAccess))
 		{
-			Bounds.SphereRadius = FMath::Max((BuildVertex.Position - FVector3f(Bounds.Origin)).Size(), Bounds.SphereRadius);
+			return nullptr;
 		}
 
-		for (const uint32 VertexIndex : Mesh.LODIndices)
+		const UUnrealSTLAssetUserData* UserData = StaticMesh->GetAssetUserData<UUnrealSTLAssetUserData>();
+		if (!UserData || !IsSameConfig(UserData->Config, File.Config))
 		{
-			LODIndices.Add(VertexBase + VertexIndex);
+			return nullptr;
 		}
-		VertexBase += Mesh.Vertices.Num();
+
+		FSHAHash Hash;
+		if (!HashFile(File.Filename, Hash) || Hash.ToString() != UserData->SourceHash)
+		{
+			return nullptr;
+		}
+
+		return StaticMesh;
 	}
-}
 
-bool UUnrealSTLFunctionLibrary::LoadMeshFromSTLData(FArrayReader& Reader, const FUnrealSTLConfig& Config, FUnrealSTLMesh& STLMesh)
-{
-	STLMesh.Vertices.Empty();
-	STLMesh.LODIndices.Empty();
-	STLMesh.TrianglesNum = 0;
+	// returns false if the facet must be discarded, fixes the normal otherwise
+	// (duplicates do not change the bounds, so their detection can be skipped when computing only them)
+	static bool CleanupFacet(FStaticMeshBuildVertex Vertex[3], const FUnrealSTLConfig& Config, TSet<FUnrealSTLFacetKey>& Facets, FUnrealSTLMesh& STLMesh, const bool bCheckDuplicates = true)
+	{
+		if (Vertex[0].Position.ContainsNaN() || Vertex[1].Position.ContainsNaN() || Vertex[2].Position.ContainsNaN())
+		{
+			STLMesh.InvalidFacetsNum++;
+			return false;
+		}
 
-	FBox BoundingBox;
-	BoundingBox.Init();
+		const FVector3f Edge1 = Vertex[1].Position - Vertex[0].Position;
+		const FVector3f Edge2 = Vertex[2].Position - Vertex[0].Position;
+		// the X axis is mirrored while loading, so the face normal is Edge2 ^ Edge1
+		FVector3f FaceNormal = FVector3f::CrossProduct(Edge2, Edge1);
+
+		// zero area (or needle-like) triangles, relative to the triangle size
+		const float MaxEdgeSizeSquared = FMath::Max3(Edge1.SizeSquared(), Edge2.SizeSquared(), (Vertex[2].Position - Vertex[1].Position).SizeSquared());
+		if (FaceNormal.SizeSquared() <= MaxEdgeSizeSquared * MaxEdgeSizeSquared * 1e-12f)
+		{
+			STLMesh.DegenerateFacetsNum++;
+			return false;
+		}
+
+		if (bCheckDuplicates)
+		{
+			bool bAlreadyInSet = false;
+			Facets.Add({ { Vertex[0].Position, Vertex[1].Position, Vertex[2].Position } }, &bAlreadyInSet);
+			if (bAlreadyInSet)
+			{
+				STLMesh.DuplicateFacetsNum++;
+				return false;
+			}
+		}
+
+		if ((Config.Transform.GetDeterminant() < 0) != Config.bReverseWinding)
+		{
+			FaceNormal = -FaceNormal;
+		}
+		FaceNormal.Normalize();
 
-	uint32 ProcessedTriangles = 0;
+		const FVector3f StoredNormal = Vertex[0].TangentZ;
+		if (StoredNormal.ContainsNaN() || StoredNormal.IsNearlyZero() || FVector3f::DotProduct(StoredNormal, FaceNormal) <= 0)
+		{
+			Vertex[0].TangentZ = FaceNormal;
+			Vertex[1].TangentZ = FaceNormal;
+			Vertex[2].TangentZ = FaceNormal;
+			STLMesh.RepairedNormalsNum++;
+		}
 
-	Reader.Seek(0);
+		return true;
+	}
 
-	if ((Config.FileMode == EUnrealSTLFileMode::Auto && !FMemory::Memcmp(Reader.GetData(), "solid", 5)) || Config.FileMode == EUnrealSTLFileMode::ASCII)
+	// collects the facets and generates bounds and indices at the end
+	struct FFacetSink
 	{
-		TArray<FString> Tokens;
-		FString Token;
-		for (int32 Offset = 0; Offset < Reader.Num(); Offset++)
+		const FUnrealSTLConfig& Config;
+		TSet<FUnrealSTLFacetKey>& Facets;
+		FUnrealSTLMesh& STLMesh;
+		FBox BoundingBox;
+
+		// only the bounding box is computed (used by probing)
+		bool bBoundsOnly;
+
+		FFacetSink(const FUnrealSTLConfig& InConfig, TSet<FUnrealSTLFacetKey>& InFacets, FUnrealSTLMesh& InSTLMesh, const bool bInBoundsOnly = false) : Config(InConfig), Facets(InFacets), STLMesh(InSTLMesh), bBoundsOnly(bInBoundsOnly)
+		{
+			// Reset() keeps the already allocated memory (useful when reusing meshes)
+			STLMesh.Vertices.Reset();
+			STLMesh.LODIndices.Reset();
+			STLMesh.Sections.Reset();
+			STLMesh.TrianglesNum = 0;
+			STLMesh.DegenerateFacetsNum = 0;
+			STLMesh.DuplicateFacetsNum = 0;
+			STLMesh.InvalidFacetsNum = 0;
+			STLMesh.RepairedNormalsNum = 0;
+
+			Facets.Reset();
+
+			BoundingBox.Init();
+		}
+
+		void Add(FStaticMeshBuildVertex Vertex[3])
 		{
-			char Char = static_cast<char>(Reader[Offset]);
-			if (Char == 0 || Char == '\r' || Char == '\n' || Char == ' ' || Char == '\t')
+			// bounds must match the ones of the loaded mesh
+			if (Config.bCleanupFacets && !CleanupFacet(Vertex, Config, Facets, STLMesh, !bBoundsOnly))
 			{
-				if (!Token.IsEmpty())
-				{
-					Tokens.Add(Token);
-					Token.Empty();
-				}
+				return;
 			}
-			else
+
+			// NaN/Inf would corrupt the bounds
+			if (bBoundsOnly && (Vertex[0].Position.ContainsNaN() || Vertex[1].Position.ContainsNaN() || Vertex[2].Position.ContainsNaN()))
+			{
+				return;
+			}
+
+			BoundingBox += FVector(Vertex[0].Position);
+			BoundingBox += FVector(Vertex[1].Position);
+			BoundingBox += FVector(Vertex[2].Position);
+
+			if (!bBoundsOnly)
+			{
+				STLMesh.Vertices.Append(Vertex, 3);
+			}
+		}
+
+		void Finalize()
+		{
+			BoundingBox.GetCenterAndExtents(STLMesh.Bounds.Origin, STLMesh.Bounds.BoxExtent);
+			STLMesh.Bounds.SphereRadius = 0;
+			STLMesh.LODIndices.Reserve(STLMesh.Vertices.Num());
+			int32 Index = 0;
+			for (const FStaticMeshBuildVertex& BuildVertex : STLMesh.Vertices)
 			{
-				Token += Char;
+				STLMesh.Bounds.SphereRadius = FMath::Max((BuildVertex.Position - FVector3f(STLMesh.Bounds.Origin)).Size(), STLMesh.Bounds.SphereRadius);
+				if (Index % 3 == 0) // generate indices every 3 vertices
+				{
+					STLMesh.LODIndices.Add(Index);
+					if (!Config.bReverseWinding)
+					{
+						STLMesh.LODIndices.Add(Index + 1);
+						STLMesh.LODIndices.Add(Index + 2);
+					}
+					else
+					{
+						STLMesh.LODIndices.Add(Index + 2);
+						STLMesh.LODIndices.Add(Index + 1);
+					}
+				}
+				Index++;
 			}
+
+			// discarded facets are not counted
+			STLMesh.TrianglesNum = STLMesh.Vertices.Num() / 3;
 		}
+	};
 
-		int32 TokenIndex = 0;
-		int32 VertexState = 0; // 0 to 2
+	// allocation-free ASCII parser (tokens are kept in a fixed buffer), data can be fed in blocks
+	struct FASCIIParser
+	{
+		static constexpr int32 MaxTokenLength = 63;
 
+		enum class EExpect : uint8
+		{
+			Keyword,
+			Normal,
+			Vertex
+		};
+
+		ANSICHAR Token[MaxTokenLength + 1];
+		int32 TokenLength;
+		EExpect Expect;
+		int32 ComponentIndex;
+		float Components[3];
+		int32 VertexState; // 0 to 2
 		FStaticMeshBuildVertex Vertex[3];
 
-		while (TokenIndex < Tokens.Num())
+		FASCIIParser()
+		{
+			TokenLength = 0;
+			Expect = EExpect::Keyword;
+			ComponentIndex = 0;
+			VertexState = 0;
+		}
+
+		void Feed(const uint8* Data, const int64 Size, FFacetSink& Sink)
 		{
-			Token = Tokens[TokenIndex++];
-			if (Token == "normal")
+			for (int64 Offset = 0; Offset < Size; Offset++)
 			{
-				if (TokenIndex + 3 > Tokens.Num())
+				const ANSICHAR Char = static_cast<ANSICHAR>(Data[Offset]);
+				if (Char == 0 || Char == '\r' || Char == '\n' || Char == ' ' || Char == '\t')
 				{
-					return false;
+					if (TokenLength > 0)
+					{
+						ProcessToken(Sink);
+					}
 				}
-				else
+				// longer tokens are truncated (they are not valid keywords or numbers anyway)
+				else if (TokenLength < MaxTokenLength)
 				{
-					float NormalX = FCString::Atof(*Tokens[TokenIndex++]);
-					float NormalY = FCString::Atof(*Tokens[TokenIndex++]);
-					float NormalZ = FCString::Atof(*Tokens[TokenIndex++]);
-					Vertex[0].TangentZ = FVector3f(Config.Transform.TransformVector(FVector(-NormalX, NormalY, NormalZ)));
-					Vertex[1].TangentZ = Vertex[0].TangentZ;
-					Vertex[2].TangentZ = Vertex[0].TangentZ;
+					Token[TokenLength++] = Char;
 				}
 			}
-			else if (Token == "vertex")
+		}
+
+		bool Finish(FFacetSink& Sink)
+		{
+			if (TokenLength > 0)
+			{
+				ProcessToken(Sink);
+			}
+			// truncated normal or vertex
+			return Expect == EExpect::Keyword;
+		}
+
+		void ProcessToken(FFacetSink& Sink)
+		{
+			Token[TokenLength] = 0;
+			TokenLength = 0;
+
+			if (Expect == EExpect::Keyword)
 			{
-				if (TokenIndex + 3 > Tokens.Num())
+				if (!FCStringAnsi::Stricmp(Token, "normal"))
 				{
-					return false;
+					Expect = EExpect::Normal;
+					ComponentIndex = 0;
 				}
-				else
+				else if (!FCStringAnsi::Stricmp(Token, "vertex"))
 				{
-					float VertexX = FCString::Atof(*Tokens[TokenIndex++]);
-					float VertexY = FCString::Atof(*Tokens[TokenIndex++]);
-					float VertexZ = FCString::Atof(*Tokens[TokenIndex++]);
-					Vertex[VertexState++].Position = FVector3f(Config.Transform.TransformPosition(FVector(-VertexX, VertexY, VertexZ)));
-					if (VertexState > 2)
-					{
-						VertexState = 0;
-						BoundingBox += FVector(Vertex[0].Position);
-						BoundingBox += FVector(Vertex[1].Position);
-						BoundingBox += FVector(Vertex[2].Position);
+					Expect = EExpect::Vertex;
+					ComponentIndex = 0;
+				}
+				return;
+			}
 
-						STLMesh.Vertices.Append(Vertex, 3);
+			Components[ComponentIndex++] = FCStringAnsi::Atof(Token);
+			if (ComponentIndex < 3)
+			{
+				return;
+			}
 
-						ProcessedTriangles++;
-					}
+			const FUnrealSTLConfig& Config = Sink.Config;
+			if (Expect == EExpect::Normal)
+			{
+				Vertex[0].TangentZ = FVector3f(Config.Transform.TransformVector(FVector(-Components[0], Components[1], Components[2])));
+				Vertex[1].TangentZ = Vertex[0].TangentZ;
+				Vertex[2].TangentZ = Vertex[0].TangentZ;
+			}
+			else
+			{
+				Vertex[VertexState++].Position = FVector3f(Config.Transform.TransformPosition(FVector(-Components[0], Components[1], Components[2])));
+				if (VertexState > 2)
+				{
+					VertexState = 0;
+					Sink.Add(Vertex);
 				}
 			}
+
+			Expect = EExpect::Keyword;
 		}
-	}
-	else
+	};
+
+	// binary parser, data can be fed in blocks (incomplete records are buffered)
+	struct FBinaryParser
 	{
-		if (Reader.Num() < UnrealSTL::BinaryHeaderSizeAndSize)
+		uint8 Record[BinaryHeaderSizeAndSize];
+		int32 RecordLength;
+		bool bHeaderParsed;
+		uint32 TrianglesNum;
+		uint32 ProcessedTriangles;
+		uint32 AttributesBytesToSkip;
+		// size of the (uncompressed) data if known, -1 otherwise
+		int64 SizeHint;
+
+		FBinaryParser()
 		{
-			return false;
+			SizeHint = -1;
+			RecordLength = 0;
+			bHeaderParsed = false;
+			TrianglesNum = 0;
+			ProcessedTriangles = 0;
+			AttributesBytesToSkip = 0;
 		}
 
-		Reader.Seek(UnrealSTL::BinaryHeaderSize);
-
-		Reader << STLMesh.TrianglesNum;
-
-		STLMesh.Vertices.Reserve(STLMesh.TrianglesNum * 3);
-
-		while (ProcessedTriangles < STLMesh.TrianglesNum)
+		void Feed(const uint8* Data, const int64 Size, FFacetSink& Sink)
 		{
-			if (Reader.Tell() + UnrealSTL::BinaryTriangleSize <= Reader.Num())
+			int64 Offset = 0;
+			while (Offset < Size)
 			{
-				FStaticMeshBuildVertex Vertex[3];
-				Reader << Vertex[0].TangentZ;
-				Vertex[1].TangentZ = Vertex[0].TangentZ;
-				Vertex[2].TangentZ = Vertex[0].TangentZ;
-				Reader << Vertex[0].Position;
-				Reader << Vertex[1].Position;
-				Reader << Vertex[2].Position;
-
-				for (int32 VertexIndex = 0; VertexIndex < 3; VertexIndex++)
+				if (AttributesBytesToSkip > 0)
 				{
-					Vertex[VertexIndex].Position = FVector3f(Config.Transform.TransformPosition(FVector(-Vertex[VertexIndex].Position.X, Vertex[VertexIndex].Position.Y, Vertex[VertexIndex].Position.Z)));
-					Vertex[VertexIndex].TangentZ = FVector3f(Config.Transform.TransformVector(FVector(Vertex[VertexIndex].TangentZ.X, Vertex[VertexIndex].TangentZ.Y, Vertex[VertexIndex].TangentZ.Z)));
+					const int64 SkipSize = FMath::Min<int64>(AttributesBytesToSkip, Size - Offset);
+					AttributesBytesToSkip -= SkipSize;
+					Offset += SkipSize;
+					continue;
 				}
 
-				BoundingBox += FVector(Vertex[0].Position);
-				BoundingBox += FVector(Vertex[1].Position);
-				BoundingBox += FVector(Vertex[2].Position);
-
-				STLMesh.Vertices.Append(Vertex, 3);
-
-				uint16 AttributesBytesCount;
-				Reader << AttributesBytesCount;
+				// trailing data is ignored
+				if (bHeaderParsed && ProcessedTriangles >= TrianglesNum)
+				{
+					return;
+				}
 
-				if (AttributesBytesCount > 0)
+				const int32 RecordSize = bHeaderParsed ? BinaryTriangleSize : BinaryHeaderSizeAndSize;
+				const uint8* RecordData = nullptr;
+				// fast path: full record available in the block
+				if (RecordLength == 0 && Size - Offset >= RecordSize)
+				{
+					RecordData = Data + Offset;
+					Offset += RecordSize;
+				}
+				else
 				{
-					int64 CurrentSeek = Reader.Tell();
-					if (CurrentSeek + AttributesBytesCount <= Reader.Num())
+					const int32 CopySize = static_cast<int32>(FMath::Min<int64>(RecordSize - RecordLength, Size - Offset));
+					FMemory::Memcpy(Record + RecordLength, Data + Offset, CopySize);
+					RecordLength += CopySize;
+					Offset += CopySize;
+					if (RecordLength < RecordSize)
 					{
-						Reader.Seek(CurrentSeek + AttributesBytesCount);
+						return;
 					}
-					else
+					RecordLength = 0;
+					RecordData = Record;
+				}
+
+				if (!bHeaderParsed)
+				{
+					FMemory::Memcpy(&TrianglesNum, RecordData + BinaryHeaderSize, sizeof(uint32));
+					// never trust the header for preallocating memory (truncated or malicious files)
+					const int64 MaxTrianglesNum = SizeHint >= BinaryHeaderSizeAndSize ? (SizeHint - BinaryHeaderSizeAndSize) / BinaryTriangleSize : MaxReservedTrianglesNum;
+					if (!Sink.bBoundsOnly)
 					{
-						return false;
+						Sink.STLMesh.Vertices.Reserve(FMath::Min<int64>(TrianglesNum, MaxTrianglesNum) * 3);
 					}
+					bHeaderParsed = true;
+				}
+				else
+				{
+					ParseTriangle(RecordData, Sink);
+				}
+			}
+		}
+
+		void ParseTriangle(const uint8* RecordData, FFacetSink& Sink)
+		{
+			const FUnrealSTLConfig& Config = Sink.Config;
+
+			float Values[12];
+			FMemory::Memcpy(Values, RecordData, sizeof(Values));
+
+			FStaticMeshBuildVertex Vertex[3];
+			// the X axis is mirrored like the positions (and like the ASCII parser)
+			Vertex[0].TangentZ = FVector3f(Config.Transform.TransformVector(FVector(-Values[0], Values[1], Values[2])));
+			Vertex[1].TangentZ = Vertex[0].TangentZ;
+			Vertex[2].TangentZ = Vertex[0].TangentZ;
+
+			for (int32 VertexIndex = 0; VertexIndex < 3; VertexIndex++)
+			{
+				const float* Position = Values + 3 + VertexIndex * 3;
+				Vertex[VertexIndex].Position = FVector3f(Config.Transform.TransformPosition(FVector(-Position[0], Position[1], Position[2])));
+			}
+
+			Sink.Add(Vertex);
+
+			uint16 AttributesBytesCount;
+			FMemory::Memcpy(&AttributesBytesCount, RecordData + sizeof(Values), sizeof(uint16));
+			AttributesBytesToSkip = AttributesBytesCount;
+
+			ProcessedTriangles++;
+		}
+
+		bool Finish()
+		{
+			// truncated file
+			return bHeaderParsed && ProcessedTriangles == TrianglesNum && AttributesBytesToSkip == 0;
+		}
+	};
+
+	// chooses the ASCII or binary parser (in Auto mode by looking at the first bytes)
+	struct FStreamParser
+	{
+		FFacetSink& Sink;
+		EUnrealSTLFileMode FileMode;
+		uint8 Magic[5];
+		int32 MagicLength;
+		FASCIIParser ASCIIParser;
+		FBinaryParser BinaryParser;
+
+		FStreamParser(FFacetSink& InSink, const int64 SizeHint) : Sink(InSink)
+		{
+			FileMode = Sink.Config.FileMode;
+			MagicLength = 0;
+			BinaryParser.SizeHint = SizeHint;
+		}
+
+		void Feed(const uint8* Data, int64 Size)
+		{
+			if (FileMode == EUnrealSTLFileMode::Auto)
+			{
+				const int32 CopySize = static_cast<int32>(FMath::Min<int64>(sizeof(Magic) - MagicLength, Size));
+				FMemory::Memcpy(Magic + MagicLength, Data, CopySize);
+				MagicLength += CopySize;
+				Data += CopySize;
+				Size -= CopySize;
+				if (MagicLength < sizeof(Magic))
+				{
+					return;
 				}
+				DetectFileMode();
+			}
+
+			FeedDetected(Data, Size);
+		}
+
+		bool Finish()
+		{
+			// very short file
+			if (FileMode == EUnrealSTLFileMode::Auto)
+			{
+				DetectFileMode();
+			}
+
+			if (FileMode == EUnrealSTLFileMode::ASCII)
+			{
+				return ASCIIParser.Finish(Sink);
+			}
+			return BinaryParser.Finish();
+		}
+
+	private:
+		void DetectFileMode()
+		{
+			FileMode = MagicLength == sizeof(Magic) && !FMemory::Memcmp(Magic, "solid", sizeof(Magic)) ? EUnrealSTLFileMode::ASCII : EUnrealSTLFileMode::Binary;
+			FeedDetected(Magic, MagicLength);
+		}
+
+		void FeedDetected(const uint8* Data, const int64 Size)
+		{
+			if (FileMode == EUnrealSTLFileMode::ASCII)
+			{
+				ASCIIParser.Feed(Data, Size, Sink);
 			}
 			else
+			{
+				BinaryParser.Feed(Data, Size, Sink);
+			}
+		}
+	};
+
+	static bool IsGzip(const uint8* Data, const int64 Size)
+	{
+		return Size >= 2 && Data[0] == 0x1f && Data[1] == 0x8b;
+	}
+
+	static bool IsZstd(const uint8* Data, const int64 Size)
+	{
+		return Size >= 4 && Data[0] == 0x28 && Data[1] == 0xb5 && Data[2] == 0x2f && Data[3] == 0xfd;
+	}
+
+	static bool IsZip(const uint8* Data, const int64 Size)
+	{
+		return Size >= 4 && Data[0] == 'P' && Data[1] == 'K' && Data[2] == 0x03 && Data[3] == 0x04;
+	}
+
+	constexpr int32 ZipLocalHeaderSize = 30;
+
+	// first entry of a zip archive
+	struct FZipEntry
+	{
+		uint16 Flags;
+		uint16 Method;
+		uint32 CompressedSize;
+		uint32 UncompressedSize;
+		int64 DataOffset;
+
+		// sizes are stored after the data (they are 0 in the local header)
+		bool HasDataDescriptor() const
+		{
+			return (Flags & 0x08) != 0;
+		}
+	};
+
+	// only stored and deflated (not encrypted) entries are supported
+	static bool ParseZipLocalHeader(const uint8* Data, const int64 Size, FZipEntry& Entry)
+	{
+		if (Size < ZipLocalHeaderSize || !IsZip(Data, Size))
+		{
+			return false;
+		}
+
+		uint16 NameLength;
+		uint16 ExtraLength;
+		FMemory::Memcpy(&Entry.Flags, Data + 6, sizeof(uint16));
+		FMemory::Memcpy(&Entry.Method, Data + 8, sizeof(uint16));
+		FMemory::Memcpy(&Entry.CompressedSize, Data + 18, sizeof(uint32));
+		FMemory::Memcpy(&Entry.UncompressedSize, Data + 22, sizeof(uint32));
+		FMemory::Memcpy(&NameLength, Data + 26, sizeof(uint16));
+		FMemory::Memcpy(&ExtraLength, Data + 28, sizeof(uint16));
+		Entry.DataOffset = ZipLocalHeaderSize + NameLength + ExtraLength;
+
+		if (Entry.Flags & 0x01)
+		{
+			UE_LOG(LogUnrealSTL, Error, TEXT("Encrypted zip archives are not supported"));
+			return false;
+		}
+
+		if (Entry.Method == 0)
+		{
+			// stored data without sizes cannot be delimited
+			if (Entry.HasDataDescriptor())
+			{
+				UE_LOG(LogUnrealSTL, Error, TEXT("Stored zip entries without sizes in the local header are not supported"));
+				return false;
+			}
+			return true;
+		}
+
+		if (Entry.Method != 8)
+		{
+			UE_LOG(LogUnrealSTL, Error, TEXT("Unsupported zip compression method %u (only stored and deflated entries are supported)"), Entry.Method);
+			return false;
+		}
+
+		return true;
+	}
+
+	// feeds Size bytes of the archive to the parser
+	static bool FeedArchive(FArchive& Archive, FStreamParser& Parser, FUnrealSTLLoaderContext& Context, const int64 Size)
+	{
+		const int64 End = Archive.Tell() + Size;
+		while (Archive.Tell() < End)
+		{
+			const int64 ReadSize = FMath::Min<int64>(End - Archive.Tell(), StreamBlockSize);
+			Archive.Serialize(Context.ReadBlock.GetData(), ReadSize);
+			if (Archive.IsError())
 			{
 				return false;
 			}
+			Parser.Feed(Context.ReadBlock.GetData(), ReadSize);
+		}
+		return true;
+	}
+
+	// inflates the archive (from its current position) block by block, each decompressed block is immediately parsed
+	static bool Inflate(FArchive& Archive, FStreamParser& Parser, FUnrealSTLLoaderContext& Context, const int WindowBits)
+	{
+		Context.ReadBlock.SetNumUninitialized(StreamBlockSize, NoShrinking);
+		Context.DecompressedBlock.SetNumUninitialized(StreamBlockSize, NoShrinking);
+
+		z_stream Stream;
+		FMemory::Memzero(Stream);
+		if (inflateInit2(&Stream, WindowBits) != Z_OK)
+		{
+			return false;
+		}
+
+		int Result = Z_OK;
+		while (Result != Z_STREAM_END)
+		{
+			if (Stream.avail_in == 0)
+			{
+				const int64 ReadSize = FMath::Min<int64>(Archive.TotalSize() - Archive.Tell(), StreamBlockSize);
+				// truncated stream
+				if (ReadSize <= 0)
+				{
+					break;
+				}
+				Archive.Serialize(Context.ReadBlock.GetData(), ReadSize);
+				if (Archive.IsError())
+				{
+					break;
+				}
+				Stream.next_in = Context.ReadBlock.GetData();
+				Stream.avail_in = static_cast<uInt>(ReadSize);
+			}
+
+			Stream.next_out = Context.DecompressedBlock.GetData();
+			Stream.avail_out = static_cast<uInt>(Context.DecompressedBlock.Num());
+
+			Result = inflate(&Stream, Z_NO_FLUSH);
+			if (Result != Z_OK && Result != Z_STREAM_END)
+			{
+				break;
+			}
+
+			Parser.Feed(Context.DecompressedBlock.GetData(), Context.DecompressedBlock.Num() - Stream.avail_out);
+		}
+
+		inflateEnd(&Stream);
+
+		return Result == Z_STREAM_END;
+	}
+
+	// Finalize() on the Sink is up to the caller
+	static bool ParseArchive(FArchive& Archive, FFacetSink& Sink, FUnrealSTLLoaderContext& Context)
+	{
+		Context.ReadBlock.SetNumUninitialized(StreamBlockSize, NoShrinking);
+
+		// enough for the magic and the zip local header
+		Archive.Seek(0);
+		const int64 HeaderSize = FMath::Min<int64>(Archive.TotalSize(), StreamBlockSize);
+		Archive.Serialize(Context.ReadBlock.GetData(), HeaderSize);
+		Archive.Seek(0);
+
+		if (Archive.IsError())
+		{
+			return false;
+		}
+
+		// zstd is not available in the engine
+		if (IsZstd(Context.ReadBlock.GetData(), HeaderSize))
+		{
+			UE_LOG(LogUnrealSTL, Error, TEXT("Zstd compressed STL files are not supported"));
+			return false;
+		}
+
+		if (IsGzip(Context.ReadBlock.GetData(), HeaderSize))
+		{
+			FStreamParser Parser(Sink, -1);
+			// 16 enables gzip decoding
+			return Inflate(Archive, Parser, Context, 16 + MAX_WBITS) && Parser.Finish();
+		}
+
+		if (IsZip(Context.ReadBlock.GetData(), HeaderSize))
+		{
+			FZipEntry Entry;
+			if (!ParseZipLocalHeader(Context.ReadBlock.GetData(), HeaderSize, Entry))
+			{
+				return false;
+			}
+
+			Archive.Seek(Entry.DataOffset);
+			if (Entry.Method == 0)
+			{
+				FStreamParser Parser(Sink, Entry.CompressedSize);
+				return FeedArchive(Archive, Parser, Context, FMath::Min<int64>(Entry.CompressedSize, Archive.TotalSize() - Entry.DataOffset)) && Parser.Finish();
+			}
+
+			FStreamParser Parser(Sink, Entry.HasDataDescriptor() ? -1 : Entry.UncompressedSize);
+			// negative window bits for raw deflate data
+			return Inflate(Archive, Parser, Context, -MAX_WBITS) && Parser.Finish();
+		}
+
+		FStreamParser Parser(Sink, Archive.TotalSize());
+		return FeedArchive(Archive, Parser, Context, Archive.TotalSize()) && Parser.Finish();
+	}
+
+	// decompresses only the beginning of a gzip (or raw deflate) stream, used by probing
+	static bool InflateFirstBlock(const uint8* CompressedData, const int64 CompressedSize, const int WindowBits, TArray<uint8>& Data, int64& ConsumedSize)
+	{
+		Data.SetNumUninitialized(StreamBlockSize, NoShrinking);
+
+		z_stream Stream;
+		FMemory::Memzero(Stream);
+		if (inflateInit2(&Stream, WindowBits) != Z_OK)
+		{
+			return false;
+		}
+
+		Stream.next_in = const_cast<Bytef*>(CompressedData);
+		Stream.avail_in = static_cast<uInt>(CompressedSize);
+		Stream.next_out = Data.GetData();
+		Stream.avail_out = static_cast<uInt>(Data.Num());
+
+		const int Result = inflate(&Stream, Z_NO_FLUSH);
+
+		inflateEnd(&Stream);
+
+		Data.SetNum(Data.Num() - Stream.avail_out, NoShrinking);
+		ConsumedSize = CompressedSize - Stream.avail_in;
+
+		return Result == Z_OK || Result == Z_STREAM_END;
+	}
+
+	// assembly files sharing content and parsing config become instances of the same part
+	struct FAssemblyPartKey
+	{
+		FSHAHash Hash;
+		EUnrealSTLFileMode FileMode;
+		bool bReverseWinding;
+		bool bCleanupFacets;
+		const UMaterialInterface* Material;
+
+		FAssemblyPartKey(const FSHAHash& InHash, const FUnrealSTLConfig& Config) : Hash(InHash), FileMode(Config.FileMode), bReverseWinding(Config.bReverseWinding), bCleanupFacets(Config.bCleanupFacets), Material(Config.Material)
+		{
+		}
+
+		bool operator==(const FAssemblyPartKey& Other) const
+		{
+			return Hash == Other.Hash && FileMode == Other.FileMode && bReverseWinding == Other.bReverseWinding && bCleanupFacets == Other.bCleanupFacets && Material == Other.Material;
+		}
+
+		friend uint32 GetTypeHash(const FAssemblyPartKey& Key)
+		{
+			uint32 KeyHash = GetTypeHash(Key.Hash);
+			KeyHash = HashCombine(KeyHash, GetTypeHash(static_cast<uint8>(Key.FileMode) | (Key.bReverseWinding ? 0x100 : 0) | (Key.bCleanupFacets ? 0x200 : 0)));
+			return HashCombine(KeyHash, GetTypeHash(Key.Material));
+		}
+	};
+
+	// per-thread context, destroyed with the thread (TLS auto cleanup) instead of at static destruction time
+	struct FThreadLoaderContext : public TThreadSingleton<FThreadLoaderContext>
+	{
+		FUnrealSTLLoaderContext Context;
+	};
+
+	// one section for each mesh
+	static TArray<TArray<const FUnrealSTLMesh*>> MakeMeshGroups(const TArray<FUnrealSTLMesh>& Meshes)
+	{
+		TArray<TArray<const FUnrealSTLMesh*>> MeshGroups;
+		for (const FUnrealSTLMesh& Mesh : Meshes)
+		{
+			MeshGroups.AddDefaulted_GetRef().Add(&Mesh);
+		}
+		return MeshGroups;
+	}
+
+	// fetches the positions and indices of a StaticMesh LOD (from the CPU copy if available or from the GPU)
+	static bool GetStaticMeshGeometry(UStaticMesh* StaticMesh, const int32 LOD, TArray<uint32>& Indices, TArray<FVector3f>& Vertices)
+	{
+		if (!StaticMesh || LOD < 0)
+		{
+			return false;
+		}
+
+		if (LOD >= StaticMesh->GetNumLODs())
+		{
+			return false;
+		}
+
+		if (!StaticMesh->GetRenderData())
+		{
+			StaticMesh->SetRenderData(MakeUnique<FStaticMeshRenderData>());
+		}
+
+		if (!StaticMesh->GetRenderData()->IsInitialized())
+		{
+			StaticMesh->InitResources();
+		}
+
+		FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
+
+		FStaticMeshLODResources& LODResources = RenderData->LODResources[LOD];
+
+#if ENGINE_MAJOR_VERSION < 5
+		if (StaticMesh->bAllowCPUAccess)
+#else
+		if (LODResources.IndexBuffer.GetAllowCPUAccess())
+#endif
+		{
+			LODResources.IndexBuffer.GetCopy(Indices);
+		}
+		else
+		{
+			if (LODResources.IndexBuffer.Is32Bit())
+			{
+#if ENGINE_MAJOR_VERSION < 5
+				void* LockedIndexBuffer = RHILockIndexBuffer(LODResources.IndexBuffer.IndexBufferRHI, 0, LODResources.IndexBuffer.GetNumIndices() * sizeof(uint32), EResourceLockMode::RLM_ReadOnly);
+				if (!LockedIndexBuffer)
+				{
+					return false;
+				}
+				Indices.Append(reinterpret_cast<uint32*>(LockedIndexBuffer), LODResources.IndexBuffer.GetNumIndices());
+				RHIUnlockIndexBuffer(LODResources.IndexBuffer.IndexBufferRHI);
+#else
+				GPUToCPU(Indices, LODResources.IndexBuffer.IndexBufferRHI, LODResources.IndexBuffer.GetNumIndices());
+#endif
+			}
+			else
+			{
+				TArray<uint16> TmpIndices;
+#if ENGINE_MAJOR_VERSION < 5
+				void* LockedIndexBuffer = RHILockIndexBuffer(LODResources.IndexBuffer.IndexBufferRHI, 0, LODResources.IndexBuffer.GetNumIndices() * sizeof(uint16), EResourceLockMode::RLM_ReadOnly);
+				if (!LockedIndexBuffer)
+				{
+					return false;
+				}
+				TmpIndices.Append(reinterpret_cast<uint16*>(LockedIndexBuffer), LODResources.IndexBuffer.GetNumIndices());
+				RHIUnlockIndexBuffer(LODResources.IndexBuffer.IndexBufferRHI);
+#else
+				GPUToCPU(TmpIndices, LODResources.IndexBuffer.IndexBufferRHI, LODResources.IndexBuffer.GetNumIndices());
+#endif
+				for (const uint16 Index : TmpIndices)
+				{
+					Indices.Add(Index);
+				}
+			}
+		}
+
+#if ENGINE_MAJOR_VERSION < 5
+		if (StaticMesh->bAllowCPUAccess)
+#else
+		if (LODResources.VertexBuffers.PositionVertexBuffer.GetAllowCPUAccess())
+#endif
+		{
+			for (uint32 VertexIndex = 0; VertexIndex < LODResources.VertexBuffers.PositionVertexBuffer.GetNumVertices(); VertexIndex++)
+			{
+				Vertices.Add(LODResources.VertexBuffers.PositionVertexBuffer.VertexPosition(VertexIndex));
+			}
+		}
+		else
+		{
+#if ENGINE_MAJOR_VERSION < 5
+			void* LockedVertexBuffer = RHILockVertexBuffer(LODResources.VertexBuffers.PositionVertexBuffer.VertexBufferRHI, 0, LODResources.VertexBuffers.PositionVertexBuffer.GetNumVertices() * sizeof(FVector), EResourceLockMode::RLM_ReadOnly);
+			if (!LockedVertexBuffer)
+			{
+				return false;
+			}
+			Vertices.Append(reinterpret_cast<FVector*>(LockedVertexBuffer), LODResources.VertexBuffers.PositionVertexBuffer.GetNumVertices());
+			RHIUnlockVertexBuffer(LODResources.VertexBuffers.PositionVertexBuffer.VertexBufferRHI);
+#else
+			GPUToCPU(Vertices, LODResources.VertexBuffers.PositionVertexBuffer.VertexBufferRHI, LODResources.VertexBuffers.PositionVertexBuffer.GetNumVertices());
+#endif
+		}
+
+		return true;
+	}
+
+	// fills a binary triangle record (normal, 3 vertices and attributes)
+	static void WriteTriangleRecord(uint8* Record, const TArray<uint32>& Indices, const TArray<FVector3f>& Vertices, const uint32 TriangleIndex, const FTransform& Transform, const bool bSwapWinding)
+	{
+		uint32 VertexIndex1 = Indices[TriangleIndex * 3];
+		uint32 VertexIndex2 = Indices[TriangleIndex * 3 + 1];
+		uint32 VertexIndex3 = Indices[TriangleIndex * 3 + 2];
+		if (bSwapWinding)
+		{
+			Swap(VertexIndex2, VertexIndex3);
+		}
+
+		const FVector3f NegateX = FVector3f(-1, 1, 1);
+		const FVector3f Vertex1 = FVector3f(Transform.TransformPosition(FVector(Vertices[VertexIndex1]))) * NegateX;
+		const FVector3f Vertex2 = FVector3f(Transform.TransformPosition(FVector(Vertices[VertexIndex2]))) * NegateX;
+		const FVector3f Vertex3 = FVector3f(Transform.TransformPosition(FVector(Vertices[VertexIndex3]))) * NegateX;
+		const FVector3f Normal = FVector3f::CrossProduct(Vertex3 - Vertex1, Vertex2 - Vertex1).GetSafeNormal();
+
+		FMemory::Memcpy(Record, &Normal, sizeof(FVector3f));
+		FMemory::Memcpy(Record + 12, &Vertex1, sizeof(FVector3f));
+		FMemory::Memcpy(Record + 24, &Vertex2, sizeof(FVector3f));
+		FMemory::Memcpy(Record + 36, &Vertex3, sizeof(FVector3f));
+		// attributes
+		Record[48] = 0;
+		Record[49] = 0;
+	}
+
+	// writes to an archive, gzip compressing the data on the fly if required
+	struct FStreamWriter
+	{
+		FArchive& Archive;
+		bool bCompress;
+		bool bError;
+		z_stream Stream;
+		TArray<uint8> CompressedBlock;
+
+		FStreamWriter(FArchive& InArchive, const bool bInCompress) : Archive(InArchive), bCompress(bInCompress), bError(false)
+		{
+			if (bCompress)
+			{
+				FMemory::Memzero(Stream);
+				// 16 enables gzip encoding
+				bError = deflateInit2(&Stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK;
+				CompressedBlock.SetNumUninitialized(StreamBlockSize);
+			}
+		}
+
+		void Write(const uint8* Data, const int64 Size)
+		{
+			if (bError)
+			{
+				return;
+			}
+
+			if (!bCompress)
+			{
+				Archive.Serialize(const_cast<uint8*>(Data), Size);
+				return;
+			}
+
+			Deflate(Data, Size, Z_NO_FLUSH);
+		}
+
+		bool Close()
+		{
+			if (bCompress && !bError)
+			{
+				Deflate(nullptr, 0, Z_FINISH);
+				deflateEnd(&Stream);
+			}
+
+			return !bError && !Archive.IsError();
+		}
+
+	private:
+		void Deflate(const uint8* Data, const int64 Size, const int Flush)
+		{
+			Stream.next_in = const_cast<Bytef*>(Data);
+			Stream.avail_in = static_cast<uInt>(Size);
+			do
+			{
+				Stream.next_out = CompressedBlock.GetData();
+				Stream.avail_out = static_cast<uInt>(CompressedBlock.Num());
+				if (deflate(&Stream, Flush) == Z_STREAM_ERROR)
+				{
+					deflateEnd(&Stream);
+					bError = true;
+					return;
+				}
+				Archive.Serialize(CompressedBlock.GetData(), CompressedBlock.Num() - Stream.avail_out);
+			} while (Stream.avail_out == 0);
+		}
+	};
+
+	static bool WriteStaticMesh(UStaticMesh* StaticMesh, const int32 LOD, const FUnrealSTLConfig& Config, FStreamWriter& Writer)
+	{
+		TArray<uint32> Indices;
+		TArray<FVector3f> Vertices;
+
+		if (!GetStaticMeshGeometry(StaticMesh, LOD, Indices, Vertices))
+		{
+			return false;
+		}
+
+		uint8 Header[BinaryHeaderSizeAndSize];
+		FMemory::Memzero(Header);
+
+		const auto SolidName = StringCast<ANSICHAR>(*StaticMesh->GetFullName());
+		FMemory::Memcpy(Header, SolidName.Get(), FMath::Min(BinaryHeaderSize, SolidName.Length()));
+
+		const uint32 NumTriangles = Indices.Num() / 3;
+		FMemory::Memcpy(Header + BinaryHeaderSize, &NumTriangles, sizeof(uint32));
+		Writer.Write(Header, BinaryHeaderSizeAndSize);
+
+		// triangles are written in batches, the whole file is never buffered
+		TArray<uint8> Records;
+		for (uint32 FirstTriangle = 0; FirstTriangle < NumTriangles; FirstTriangle += ExportBatchTrianglesNum)
+		{
+			const uint32 BatchTrianglesNum = FMath::Min(ExportBatchTrianglesNum, NumTriangles - FirstTriangle);
+			Records.SetNumUninitialized(BatchTrianglesNum * BinaryTriangleSize, NoShrinking);
+			for (uint32 TriangleIndex = 0; TriangleIndex < BatchTrianglesNum; TriangleIndex++)
+			{
+				WriteTriangleRecord(Records.GetData() + TriangleIndex * BinaryTriangleSize, Indices, Vertices, FirstTriangle + TriangleIndex, Config.Transform, Config.bReverseWinding);
+			}
+			Writer.Write(Records.GetData(), Records.Num());
+		}
+
+		return true;
+	}
+
+	// the file is removed on failure
+	static bool SaveToFile(const FString& Filename, TFunctionRef<bool(FStreamWriter&)> Write)
+	{
+		TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*Filename));
+		if (!Writer)
+		{
+			return false;
+		}
+
+		// .gz files are compressed
+		FStreamWriter StreamWriter(*Writer, Filename.EndsWith(TEXT(".gz"), ESearchCase::IgnoreCase));
+		const bool bWritten = Write(StreamWriter);
+		const bool bClosed = StreamWriter.Close() && Writer->Close();
+
+		if (!bWritten || !bClosed)
+		{
+			Writer.Reset();
+			IFileManager::Get().Delete(*Filename);
+			return false;
+		}
+
+		return true;
+	}
+
+	// editor-only visualization meshes (e.g. camera and light helpers) and components hidden in game are not part of the exported scene
+	static bool IsExportableComponent(const UStaticMeshComponent* Component)
+	{
+		if (Component->IsEditorOnly() || Component->bHiddenInGame)
+		{
+			return false;
+		}
+
+		const AActor* Owner = Component->GetOwner();
+		return !Owner || !Owner->IsEditorOnly();
+	}
+
+	static bool WriteStaticMeshComponents(const TArray<UStaticMeshComponent*>& Components, const int32 LOD, const FUnrealSTLConfig& Config, FStreamWriter& Writer)
+	{
+		struct FInstance
+		{
+			int32 MeshIndex;
+			FTransform Transform;
+		};
+
+		// a slice of the triangles of an instance, written by a single task
+		struct FTask
+		{
+			int32 InstanceIndex;
+			uint32 FirstTriangle;
+			uint32 TrianglesNum;
+			uint32 BatchOffset;
+		};
+
+		TArray<UStaticMesh*> StaticMeshes;
+		TMap<UStaticMesh*, int32> StaticMeshesMap;
+		TArray<FInstance> Instances;
+
+		for (UStaticMeshComponent* Component : Components)
+		{
+			if (!Component || !Component->GetStaticMesh() || !IsExportableComponent(Component))
+			{
+				continue;
+			}
+
+			UStaticMesh* StaticMesh = Component->GetStaticMesh();
+			const int32* StaticMeshIndex = StaticMeshesMap.Find(StaticMesh);
+			const int32 MeshIndex = StaticMeshIndex ? *StaticMeshIndex : StaticMeshesMap.Add(StaticMesh, StaticMeshes.Add(StaticMesh));
+
+			if (UInstancedStaticMeshComponent* InstancedComponent = Cast<UInstancedStaticMeshComponent>(Component))
+			{
+				for (int32 InstanceIndex = 0; InstanceIndex < InstancedComponent->GetInstanceCount(); InstanceIndex++)
+				{
+					FTransform InstanceTransform;
+					if (InstancedComponent->GetInstanceTransform(InstanceIndex, InstanceTransform, true))
+					{
+						Instances.Add({ MeshIndex, InstanceTransform });
+					}
+				}
+			}
+			else
+			{
+				Instances.Add({ MeshIndex, Component->GetComponentTransform() });
+			}
+		}
+
+		// the geometry of each StaticMesh is fetched only once
+		TArray<TArray<uint32>> MeshesIndices;
+		TArray<TArray<FVector3f>> MeshesVertices;
+		MeshesIndices.AddDefaulted(StaticMeshes.Num());
+		MeshesVertices.AddDefaulted(StaticMeshes.Num());
+		for (int32 MeshIndex = 0; MeshIndex < StaticMeshes.Num(); MeshIndex++)
+		{
+			const int32 MeshLOD = FMath::Clamp(LOD, 0, StaticMeshes[MeshIndex]->GetNumLODs() - 1);
+			if (!GetStaticMeshGeometry(StaticMeshes[MeshIndex], MeshLOD, MeshesIndices[MeshIndex], MeshesVertices[MeshIndex]))
+			{
+				return false;
+			}
+		}
+
+		uint64 TotalTrianglesNum = 0;
+		for (const FInstance& Instance : Instances)
+		{
+			TotalTrianglesNum += MeshesIndices[Instance.MeshIndex].Num() / 3;
+		}
+
+		if (TotalTrianglesNum > MAX_uint32)
+		{
+			return false;
+		}
+
+		uint8 Header[BinaryHeaderSizeAndSize];
+		FMemory::Memzero(Header);
+		FMemory::Memcpy(Header, "UnrealSTL scene", 15);
+		const uint32 TrianglesNum = static_cast<uint32>(TotalTrianglesNum);
+		FMemory::Memcpy(Header + BinaryHeaderSize, &TrianglesNum, sizeof(uint32));
+		Writer.Write(Header, BinaryHeaderSizeAndSize);
+
+		TArray<uint8> Records;
+		TArray<FTask> Tasks;
+		uint32 BatchTrianglesNum = 0;
+
+		auto FlushBatch = [&]()
+		{
+			Records.SetNumUninitialized(BatchTrianglesNum * BinaryTriangleSize, NoShrinking);
+
+			ParallelFor(Tasks.Num(), [&](const int32 TaskIndex)
+				{
+					const FTask& Task = Tasks[TaskIndex];
+					const FInstance& Instance = Instances[Task.InstanceIndex];
+					const TArray<uint32>& Indices = MeshesIndices[Instance.MeshIndex];
+					const TArray<FVector3f>& Vertices = MeshesVertices[Instance.MeshIndex];
+
+					const FTransform Transform = Instance.Transform * Config.Transform;
+					// mirrored instances would flip the facets
+					const bool bSwapWinding = Config.bReverseWinding != (Transform.GetDeterminant() < 0);
+
+					uint8* Record = Records.GetData() + static_cast<int64>(Task.BatchOffset) * BinaryTriangleSize;
+					for (uint32 TriangleIndex = Task.FirstTriangle; TriangleIndex < Task.FirstTriangle + Task.TrianglesNum; TriangleIndex++)
+					{
+						WriteTriangleRecord(Record, Indices, Vertices, TriangleIndex, Transform, bSwapWinding);
+						Record += BinaryTriangleSize;
+					}
+				});
+
+			Writer.Write(Records.GetData(), Records.Num());
+
+			Tasks.Reset();
+			BatchTrianglesNum = 0;
+		};
+
+		for (int32 InstanceIndex = 0; InstanceIndex < Instances.Num(); InstanceIndex++)
+		{
+			const uint32 InstanceTrianglesNum = MeshesIndices[Instances[InstanceIndex].MeshIndex].Num() / 3;
+			for (uint32 FirstTriangle = 0; FirstTriangle < InstanceTrianglesNum; FirstTriangle += ExportTaskTrianglesNum)
+			{
+				const uint32 TaskTrianglesNum = FMath::Min(ExportTaskTrianglesNum, InstanceTrianglesNum - FirstTriangle);
+				Tasks.Add({ InstanceIndex, FirstTriangle, TaskTrianglesNum, BatchTrianglesNum });
+				BatchTrianglesNum += TaskTrianglesNum;
+				if (BatchTrianglesNum >= ExportBatchTrianglesNum)
+				{
+					FlushBatch();
+				}
+			}
+		}
+
+		if (Tasks.Num() > 0)
+		{
+			FlushBatch();
+		}
+
+		return true;
+	}
+}
+
+FUnrealSTLMesh::FUnrealSTLMesh()
+{
+	TrianglesNum = 0;
+	DegenerateFacetsNum = 0;
+	DuplicateFacetsNum = 0;
+	InvalidFacetsNum = 0;
+	RepairedNormalsNum = 0;
+}
+
+FUnrealSTLMesh::FUnrealSTLMesh(const TArray<FUnrealSTLMesh>& Meshes) : FUnrealSTLMesh(UnrealSTL::MakeMeshGroups(Meshes))
+{
+}
+
+FUnrealSTLMesh::FUnrealSTLMesh(const TArray<TArray<const FUnrealSTLMesh*>>& MeshGroups) : FUnrealSTLMesh()
+{
+	Merge(MeshGroups);
+}
+
+void FUnrealSTLMesh::Merge(const TArray<TArray<const FUnrealSTLMesh*>>& MeshGroups)
+{
+	// Reset() keeps the already allocated memory
+	Vertices.Reset();
+	LODIndices.Reset();
+	Sections.Reset();
+	TrianglesNum = 0;
+
+	FBox BoundingBox;
+	BoundingBox.Init();
+
+	int32 VerticesNum = 0;
+	int32 IndicesNum = 0;
+	for (const TArray<const FUnrealSTLMesh*>& MeshGroup : MeshGroups)
+	{
+		for (const FUnrealSTLMesh* Mesh : MeshGroup)
+		{
+			VerticesNum += Mesh->Vertices.Num();
+			IndicesNum += Mesh->LODIndices.Num();
+		}
+	}
+	Vertices.Reserve(VerticesNum);
+	LODIndices.Reserve(IndicesNum);
+
+	for (const TArray<const FUnrealSTLMesh*>& MeshGroup : MeshGroups)
+	{
+		for (const FUnrealSTLMesh* Mesh : MeshGroup)
+		{
+			Vertices += Mesh->Vertices;
+			TrianglesNum += Mesh->TrianglesNum;
+			BoundingBox += Mesh->Bounds.GetBox();
+		}
+	}
+
+	BoundingBox.GetCenterAndExtents(Bounds.Origin, Bounds.BoxExtent);
+	Bounds.SphereRadius = 0;
+	uint32 VertexBase = 0;
+	for (const TArray<const FUnrealSTLMesh*>& MeshGroup : MeshGroups)
+	{
+		FStaticMeshSection Section;
+		Section.FirstIndex = LODIndices.Num();
+		Section.NumTriangles = 0;
+		for (const FUnrealSTLMesh* Mesh : MeshGroup)
+		{
+			Section.NumTriangles += Mesh->TrianglesNum;
+			for (const FStaticMeshBuildVertex& BuildVertex : Mesh->Vertices)
+			{
+				Bounds.SphereRadius = FMath::Max((BuildVertex.Position - FVector3f(Bounds.Origin)).Size(), Bounds.SphereRadius);
+			}
+
+			for (const uint32 VertexIndex : Mesh->LODIndices)
+			{
+				LODIndices.Add(VertexBase + VertexIndex);
+			}
+			VertexBase += Mesh->Vertices.Num();
+		}
+		Sections.Add(Section);
+	}
+}
+
+FUnrealSTLLoaderContext& FUnrealSTLLoaderContext::GetForCurrentThread()
+{
+	return UnrealSTL::FThreadLoaderContext::Get().Context;
+}
+
+void FUnrealSTLLoaderContext::Empty()
+{
+	ReadBlock.Empty();
+	DecompressedBlock.Empty();
+	STLMeshLODs.Empty();
+	Facets.Empty();
+	MergedSections = FUnrealSTLMesh();
+}
+
+void FUnrealSTLLoaderContext::Trim(const int64 MaxRetainedSize)
+{
+	if (static_cast<int64>(ReadBlock.GetAllocatedSize()) > MaxRetainedSize)
+	{
+		ReadBlock.Empty();
+	}
+
+	if (static_cast<int64>(DecompressedBlock.GetAllocatedSize()) > MaxRetainedSize)
+	{
+		DecompressedBlock.Empty();
+	}
+
+	int64 STLMeshLODsSize = 0;
+	for (const TArray<FUnrealSTLMesh>& STLMeshes : STLMeshLODs)
+	{
+		for (const FUnrealSTLMesh& STLMesh : STLMeshes)
+		{
+			STLMeshLODsSize += STLMesh.Vertices.GetAllocatedSize() + STLMesh.LODIndices.GetAllocatedSize();
+		}
+	}
+
+	if (STLMeshLODsSize > MaxRetainedSize)
+	{
+		STLMeshLODs.Empty();
+	}
+
+	if (static_cast<int64>(Facets.GetAllocatedSize()) > MaxRetainedSize)
+	{
+		Facets.Empty();
+	}
+
+	if (static_cast<int64>(MergedSections.Vertices.GetAllocatedSize() + MergedSections.LODIndices.GetAllocatedSize()) > MaxRetainedSize)
+	{
+		MergedSections = FUnrealSTLMesh();
+	}
+}
+
+bool UUnrealSTLFunctionLibrary::LoadMeshFromSTLData(FArrayReader& Reader, const FUnrealSTLConfig& Config, FUnrealSTLMesh& STLMesh)
+{
+	FUnrealSTLLoaderContext Context;
+	return LoadMeshFromSTLData(Reader, Config, STLMesh, Context);
+}
+
+bool UUnrealSTLFunctionLibrary::LoadMeshFromSTLData(FArrayReader& Reader, const FUnrealSTLConfig& Config, FUnrealSTLMesh& STLMesh, FUnrealSTLLoaderContext& Context)
+{
+	UnrealSTL::FFacetSink Sink(Config, Context.Facets, STLMesh);
+
+	// compressed (or unsupported) data is inflated block by block like files
+	if (UnrealSTL::IsGzip(Reader.GetData(), Reader.Num()) || UnrealSTL::IsZip(Reader.GetData(), Reader.Num()) || UnrealSTL::IsZstd(Reader.GetData(), Reader.Num()))
+	{
+		if (!UnrealSTL::ParseArchive(Reader, Sink, Context))
+		{
+			return false;
+		}
+
+		Sink.Finalize();
+
+		return true;
+	}
+
+	UnrealSTL::FStreamParser Parser(Sink, Reader.Num());
+	Parser.Feed(Reader.GetData(), Reader.Num());
+
+	if (!Parser.Finish())
+	{
+		return false;
+	}
+
+	Sink.Finalize();
+
+	return true;
+}
+
+bool UUnrealSTLFunctionLibrary::LoadMeshFromSTLFile(const FString& Filename, const FUnrealSTLConfig& Config, FUnrealSTLMesh& STLMesh, FUnrealSTLLoaderContext& Context)
+{
+	// the file is streamed in blocks (decompressing it if required) instead of being loaded in memory
+	TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*Filename));
+	if (!Reader)
+	{
+		return false;
+	}
+
+	UnrealSTL::FFacetSink Sink(Config, Context.Facets, STLMesh);
+	if (!UnrealSTL::ParseArchive(*Reader, Sink, Context))
+	{
+		return false;
+	}
+
+	Sink.Finalize();
+
+	return true;
+}
+
+bool UUnrealSTLFunctionLibrary::ProbeSTLFile(const FString& Filename, const FUnrealSTLConfig& Config, const bool bComputeBounds, FUnrealSTLProbe& Probe)
+{
+	Probe = FUnrealSTLProbe();
+
+	TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*Filename));
+	if (!Reader)
+	{
+		return false;
+	}
+
+	Probe.FileSize = Reader->TotalSize();
+
+	// only the first block is read
+	TArray<uint8> Block;
+	Block.SetNumUninitialized(FMath::Min<int64>(Probe.FileSize, UnrealSTL::StreamBlockSize));
+	Reader->Serialize(Block.GetData(), Block.Num());
+	if (Reader->IsError())
+	{
+		return false;
+	}
+
+	if (UnrealSTL::IsZstd(Block.GetData(), Block.Num()))
+	{
+		UE_LOG(LogUnrealSTL, Error, TEXT("Zstd compressed STL files are not supported"));
+		return false;
+	}
+
+	int64 DataSize = Probe.FileSize;
+	if (UnrealSTL::IsGzip(Block.GetData(), Block.Num()))
+	{
+		Probe.bCompressed = true;
+
+		// the uncompressed size (modulo 2^32) is in the gzip footer
+		uint32 UncompressedSize = 0;
+		if (Probe.FileSize < 4)
+		{
+			return false;
+		}
+		Reader->Seek(Probe.FileSize - 4);
+		*Reader << UncompressedSize;
+		DataSize = UncompressedSize;
+
+		TArray<uint8> DecompressedBlock;
+		int64 ConsumedSize = 0;
+		if (!UnrealSTL::InflateFirstBlock(Block.GetData(), Block.Num(), 16 + MAX_WBITS, DecompressedBlock, ConsumedSize))
+		{
+			return false;
+		}
+		Block = MoveTemp(DecompressedBlock);
+	}
+	else if (UnrealSTL::IsZip(Block.GetData(), Block.Num()))
+	{
+		Probe.bCompressed = true;
+
+		UnrealSTL::FZipEntry Entry;
+		if (!UnrealSTL::ParseZipLocalHeader(Block.GetData(), Block.Num(), Entry) || Entry.DataOffset > Block.Num())
+		{
+			return false;
+		}
+
+		TArray<uint8> DecompressedBlock;
+		if (Entry.Method == 0)
+		{
+			DataSize = Entry.CompressedSize;
+			DecompressedBlock.Append(Block.GetData() + Entry.DataOffset, Block.Num() - Entry.DataOffset);
+		}
+		else
+		{
+			int64 ConsumedSize = 0;
+			if (!UnrealSTL::InflateFirstBlock(Block.GetData() + Entry.DataOffset, Block.Num() - Entry.DataOffset, -MAX_WBITS, DecompressedBlock, ConsumedSize))
+			{
+				return false;
+			}
+			// sizes are stored after the data, extrapolate the compression ratio of the first block
+			DataSize = Entry.HasDataDescriptor() ? (ConsumedSize > 0 ? (Probe.FileSize - Entry.DataOffset) * DecompressedBlock.Num() / ConsumedSize : 0) : Entry.UncompressedSize;
+		}
+		Block = MoveTemp(DecompressedBlock);
+	}
+
+	const bool bASCII = Config.FileMode == EUnrealSTLFileMode::ASCII || (Config.FileMode == EUnrealSTLFileMode::Auto && Block.Num() >= 5 && !FMemory::Memcmp(Block.GetData(), "solid", 5));
+	if (bASCII)
+	{
+		Probe.FileMode = EUnrealSTLFileMode::ASCII;
+
+		int64 LinesNum = 0;
+		if (Probe.bCompressed)
+		{
+			// extrapolated from the first block
+			for (const uint8 Char : Block)
+			{
+				LinesNum += Char == '\n' ? 1 : 0;
+			}
+			LinesNum = Block.Num() > 0 ? LinesNum * DataSize / Block.Num() : 0;
+		}
+		else
+		{
+			// fast newline scan
+			Reader->Seek(0);
+			Block.SetNumUninitialized(UnrealSTL::StreamBlockSize, UnrealSTL::NoShrinking);
+			while (Reader->Tell() < Probe.FileSize)
+			{
+				const int64 ReadSize = FMath::Min<int64>(Probe.FileSize - Reader->Tell(), UnrealSTL::StreamBlockSize);
+				Reader->Serialize(Block.GetData(), ReadSize);
+				if (Reader->IsError())
+				{
+					return false;
+				}
+				for (int64 Offset = 0; Offset < ReadSize; Offset++)
+				{
+					LinesNum += Block[Offset] == '\n' ? 1 : 0;
+				}
+			}
+		}
+
+		Probe.TrianglesNum = LinesNum / UnrealSTL::ASCIILinesPerTriangle;
+		Probe.bHeaderValid = true;
+	}
+	else
+	{
+		Probe.FileMode = EUnrealSTLFileMode::Binary;
+
+		if (DataSize < UnrealSTL::BinaryHeaderSizeAndSize || Block.Num() < UnrealSTL::BinaryHeaderSizeAndSize)
+		{
+			return false;
+		}
+
+		uint32 HeaderTrianglesNum = 0;
+		FMemory::Memcpy(&HeaderTrianglesNum, Block.GetData() + UnrealSTL::BinaryHeaderSize, sizeof(uint32));
+
+		const int64 MaxTrianglesNum = (DataSize - UnrealSTL::BinaryHeaderSizeAndSize) / UnrealSTL::BinaryTriangleSize;
+		Probe.bHeaderValid = HeaderTrianglesNum <= MaxTrianglesNum;
+		Probe.TrianglesNum = FMath::Min<int64>(HeaderTrianglesNum, MaxTrianglesNum);
+	}
 
-			ProcessedTriangles++;
-		}
+	// vertices are not shared between triangles
+	const int64 VerticesNum = Probe.TrianglesNum * 3;
+	// parsed vertices + indices (+ the file blocks)
+	Probe.EstimatedCPUMemory = VerticesNum * (sizeof(FStaticMeshBuildVertex) + sizeof(uint32)) + UnrealSTL::StreamBlockSize * 2;
+	if (Config.bCleanupFacets)
+	{
+		// duplicates detection set (element + hash bucket)
+		Probe.EstimatedCPUMemory += Probe.TrianglesNum * (sizeof(TSetElement<FUnrealSTLFacetKey>) + sizeof(FSetElementId));
 	}
+	// position + tangents + one half precision UV + indices
+	Probe.EstimatedGPUMemory = VerticesNum * (sizeof(FVector3f) + sizeof(FPackedNormal) * 2 + sizeof(FVector2DHalf) + (VerticesNum > MAX_uint16 ? sizeof(uint32) : sizeof(uint16)));
 
-	BoundingBox.GetCenterAndExtents(STLMesh.Bounds.Origin, STLMesh.Bounds.BoxExtent);
-	STLMesh.Bounds.SphereRadius = 0;
-	int32 Index = 0;
-	for (const FStaticMeshBuildVertex& BuildVertex : STLMesh.Vertices)
+	if (bComputeBounds)
 	{
-		STLMesh.Bounds.SphereRadius = FMath::Max((BuildVertex.Position - FVector3f(STLMesh.Bounds.Origin)).Size(), STLMesh.Bounds.SphereRadius);
-		if (Index % 3 == 0) // generate indices every 3 vertices
+		FUnrealSTLMesh STLMesh;
+		UnrealSTL::FFacetSink Sink(Config, FUnrealSTLLoaderContext::GetForCurrentThread().Facets, STLMesh, true);
+		if (!UnrealSTL::ParseArchive(*Reader, Sink, FUnrealSTLLoaderContext::GetForCurrentThread()))
 		{
-			STLMesh.LODIndices.Add(Index);
-			if (!Config.bReverseWinding)
-			{
-				STLMesh.LODIndices.Add(Index + 1);
-				STLMesh.LODIndices.Add(Index + 2);
-			}
-			else
-			{
-				STLMesh.LODIndices.Add(Index + 2);
-				STLMesh.LODIndices.Add(Index + 1);
-			}
+			return false;
 		}
-		Index++;
-	}
 
-	STLMesh.TrianglesNum = ProcessedTriangles;
+		Probe.bHasBounds = Sink.BoundingBox.IsValid != 0;
+		Probe.Bounds = Sink.BoundingBox;
+	}
 
 	return true;
 }
@@ -267,23 +1615,102 @@ UStaticMesh* UUnrealSTLFunctionLibrary::LoadStaticMeshFromSTLFile(const FString&
 }
 
 UStaticMesh* UUnrealSTLFunctionLibrary::LoadStaticMeshFromSTLFileLODs(const TArray<FUnrealSTLFileLOD>& FileLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig)
+{
+	FUnrealSTLLoaderContext Context;
+	return LoadStaticMeshFromSTLFileLODsWithContext(FileLODs, StaticMeshConfig, Context);
+}
+
+UStaticMesh* UUnrealSTLFunctionLibrary::LoadStaticMeshFromSTLFileLODsWithContext(const TArray<FUnrealSTLFileLOD>& FileLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, FUnrealSTLLoaderContext& Context)
 {
 	if (FileLODs.Num() < 1)
 	{
 		return nullptr;
 	}
 
+	// prebuilt (and eventually Nanite-enabled) assets are preferred to runtime generated meshes
+	if (!StaticMeshConfig.CookedContentPath.IsEmpty() && FileLODs.Num() == 1 && FileLODs[0].Sections.Num() == 1)
+	{
+		UStaticMesh* CookedStaticMesh = UnrealSTL::LoadCookedStaticMesh(FileLODs[0].Sections[0], StaticMeshConfig);
+		if (CookedStaticMesh)
+		{
+			return CookedStaticMesh;
+		}
+	}
+
+	// the meshes of the previous load are reused
+	Context.STLMeshLODs.SetNum(FileLODs.Num());
+	for (int32 LODIndex = 0; LODIndex < FileLODs.Num(); LODIndex++)
+	{
+		const FUnrealSTLFileLOD& FileLOD = FileLODs[LODIndex];
+		TArray<FUnrealSTLMesh>& STLMeshes = Context.STLMeshLODs[LODIndex];
+		STLMeshes.SetNum(FileLOD.Sections.Num());
+		for (int32 SectionIndex = 0; SectionIndex < FileLOD.Sections.Num(); SectionIndex++)
+		{
+			const FUnrealSTLFile& File = FileLOD.Sections[SectionIndex];
+			if (!LoadMeshFromSTLFile(File.Filename, File.Config, STLMeshes[SectionIndex], Context))
+			{
+				return nullptr;
+			}
+		}
+	}
+
+	return LoadStaticMeshFromSTLMeshLODs(FileLODs, Context.STLMeshLODs, StaticMeshConfig, Context);
+}
+
+UStaticMesh* UUnrealSTLFunctionLibrary::LoadStaticMeshFromSTLMeshLODs(const TArray<FUnrealSTLFileLOD>& FileLODs, const TArray<TArray<FUnrealSTLMesh>>& STLMeshLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig)
+{
+	FUnrealSTLLoaderContext Context;
+	return LoadStaticMeshFromSTLMeshLODs(FileLODs, STLMeshLODs, StaticMeshConfig, Context);
+}
+
+UStaticMesh* UUnrealSTLFunctionLibrary::LoadStaticMeshFromSTLMeshLODs(const TArray<FUnrealSTLFileLOD>& FileLODs, const TArray<TArray<FUnrealSTLMesh>>& STLMeshLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, FUnrealSTLLoaderContext& Context)
+{
 	UStaticMesh* StaticMesh = NewObject<UStaticMesh>(StaticMeshConfig.Outer ? StaticMeshConfig.Outer : GetTransientPackage());
 
+	if (!UpdateStaticMeshFromSTLMeshLODs(StaticMesh, FileLODs, STLMeshLODs, StaticMeshConfig, Context))
+	{
+		return nullptr;
+	}
+
+	return StaticMesh;
+}
+
+bool UUnrealSTLFunctionLibrary::UpdateStaticMeshFromSTLMeshLODs(UStaticMesh* StaticMesh, const TArray<FUnrealSTLFileLOD>& FileLODs, const TArray<TArray<FUnrealSTLMesh>>& STLMeshLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig)
+{
+	FUnrealSTLLoaderContext Context;
+	return UpdateStaticMeshFromSTLMeshLODs(StaticMesh, FileLODs, STLMeshLODs, StaticMeshConfig, Context);
+}
+
+bool UUnrealSTLFunctionLibrary::UpdateStaticMeshFromSTLMeshLODs(UStaticMesh* StaticMesh, const TArray<FUnrealSTLFileLOD>& FileLODs, const TArray<TArray<FUnrealSTLMesh>>& STLMeshLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, FUnrealSTLLoaderContext& Context)
+{
+	if (!StaticMesh || FileLODs.Num() < 1 || FileLODs.Num() != STLMeshLODs.Num())
+	{
+		return false;
+	}
+
+	for (int32 LODIndex = 0; LODIndex < FileLODs.Num(); LODIndex++)
+	{
+		if (STLMeshLODs[LODIndex].Num() < 1 || FileLODs[LODIndex].Sections.Num() != STLMeshLODs[LODIndex].Num())
+		{
+			return false;
+		}
+	}
+
+	// components using the mesh will get their render state recreated when the context goes out of scope
+	FStaticMeshComponentRecreateRenderStateContext RecreateRenderStateContext(StaticMesh, false, true);
+
 	StaticMesh->NeverStream = true;
 
 #if WITH_EDITOR
 	StaticMesh->bAutoComputeLODScreenSize = false;
+	StaticMesh->SetNumSourceModels(0);
+	StaticMesh->GetSectionInfoMap().Clear();
 #endif
 
 	if (StaticMesh->GetRenderData())
 	{
-		StaticMesh->GetRenderData()->ReleaseResources();
+		StaticMesh->ReleaseResources();
+		FlushRenderingCommands();
 	}
 
 	StaticMesh->SetRenderData(MakeUnique<FStaticMeshRenderData>());
@@ -293,6 +1720,8 @@ UStaticMesh* UUnrealSTLFunctionLibrary::LoadStaticMeshFromSTLFileLODs(const TArr
 
 	int32 LODIndex = 0;
 	TArray<FStaticMaterial> StaticMaterials;
+	// material slots are shared between sections and LODs when merging
+	TMap<UMaterialInterface*, int32> MaterialSlots;
 	for (const FUnrealSTLFileLOD& FileLOD : FileLODs)
 	{
 		FStaticMeshLODResources& LODResources = RenderData->LODResources[LODIndex];
@@ -309,60 +1738,88 @@ UStaticMesh* UUnrealSTLFunctionLibrary::LoadStaticMeshFromSTLFileLODs(const TArr
 		FStaticMeshSectionArray& Sections = LODResources.Sections;
 #endif
 
-		TArray<FUnrealSTLMesh> STLMeshes;
-		for (const FUnrealSTLFile& File : FileLOD.Sections)
+		const TArray<FUnrealSTLMesh>& STLMeshes = STLMeshLODs[LODIndex];
+
+		// a bit of hacky optimizations... (multiple sections are merged in the reusable buffers of the Context)
+		const FUnrealSTLMesh* STLSectionsPtr;
+		// the material of each section (nullptr for the default one)
+		TArray<UMaterialInterface*> SectionMaterials;
+		if (StaticMeshConfig.bMergeSectionsByMaterial)
 		{
-			FArrayReader Data;
-			if (!FFileHelper::LoadFileToArray(Data, *File.Filename))
+			TArray<TArray<const FUnrealSTLMesh*>> MaterialGroups;
+			for (int32 MeshIndex = 0; MeshIndex < STLMeshes.Num(); MeshIndex++)
 			{
-				return nullptr;
+				UMaterialInterface* Material = FileLOD.Sections[MeshIndex].Config.Material;
+				int32 GroupIndex = SectionMaterials.Find(Material);
+				if (GroupIndex == INDEX_NONE)
+				{
+					GroupIndex = SectionMaterials.Add(Material);
+					MaterialGroups.AddDefaulted();
+				}
+				MaterialGroups[GroupIndex].Add(&STLMeshes[MeshIndex]);
 			}
-			FUnrealSTLMesh STLMesh;
-			if (!LoadMeshFromSTLData(Data, File.Config, STLMesh))
+
+			if (STLMeshes.Num() == 1)
 			{
-				return nullptr;
+				STLSectionsPtr = &STLMeshes[0];
+			}
+			else
+			{
+				Context.MergedSections.Merge(MaterialGroups);
+				STLSectionsPtr = &Context.MergedSections;
 			}
-			STLMeshes.Add(MoveTemp(STLMesh));
-		}
-
-		// a bit of hacky optimizations...
-		FUnrealSTLMesh STLMergedSections;
-		FUnrealSTLMesh* STLSectionsPtr;
-		if (STLMeshes.Num() == 1)
-		{
-			STLSectionsPtr = &STLMeshes[0];
 		}
 		else
 		{
-			STLMergedSections = FUnrealSTLMesh(STLMeshes);
-			STLSectionsPtr = &STLMergedSections;
-		}
+			for (const FUnrealSTLFile& File : FileLOD.Sections)
+			{
+				SectionMaterials.Add(File.Config.Material);
+			}
 
-		if (STLSectionsPtr->Sections.Num() == 0)
-		{
-			FStaticMeshSection DefaultSection;
-			DefaultSection.NumTriangles = STLSectionsPtr->TrianglesNum;
-			STLSectionsPtr->Sections.Add(DefaultSection);
+			if (STLMeshes.Num() == 1)
+			{
+				STLSectionsPtr = &STLMeshes[0];
+			}
+			else
+			{
+				Context.MergedSections.Merge(UnrealSTL::MakeMeshGroups(STLMeshes));
+				STLSectionsPtr = &Context.MergedSections;
+			}
 		}
 
-		for (int32 SectionIndex = 0; SectionIndex < STLSectionsPtr->Sections.Num(); SectionIndex++)
+		// single mesh without sections, no need to copy anything
+		FStaticMeshSection DefaultSection;
+		DefaultSection.NumTriangles = STLSectionsPtr->TrianglesNum;
+		const TArrayView<const FStaticMeshSection> STLSections = STLSectionsPtr->Sections.Num() > 0 ? TArrayView<const FStaticMeshSection>(STLSectionsPtr->Sections) : TArrayView<const FStaticMeshSection>(&DefaultSection, 1);
+
+		for (int32 SectionIndex = 0; SectionIndex < STLSections.Num(); SectionIndex++)
 		{
 			FStaticMeshSection& Section = Sections.AddDefaulted_GetRef();
 
-			Section.FirstIndex = STLSectionsPtr->Sections[SectionIndex].FirstIndex;
-			Section.NumTriangles = STLSectionsPtr->Sections[SectionIndex].NumTriangles;
-			Section.MaterialIndex = StaticMaterials.Num();
+			Section.FirstIndex = STLSections[SectionIndex].FirstIndex;
+			Section.NumTriangles = STLSections[SectionIndex].NumTriangles;
+
+			UMaterialInterface* SectionMaterial = SectionMaterials[SectionIndex];
+			const int32* MaterialSlot = StaticMeshConfig.bMergeSectionsByMaterial ? MaterialSlots.Find(SectionMaterial) : nullptr;
+			if (MaterialSlot)
+			{
+				Section.MaterialIndex = *MaterialSlot;
+			}
+			else
+			{
+				Section.MaterialIndex = StaticMaterials.Num();
+				const FString SlotName = StaticMeshConfig.bMergeSectionsByMaterial ? FString::Printf(TEXT("Material_%d"), Section.MaterialIndex) : FString::Printf(TEXT("LOD_%u_Section_%u"), LODIndex, SectionIndex);
+				FStaticMaterial Material(SectionMaterial ? SectionMaterial : UMaterial::GetDefaultMaterial(MD_Surface), *SlotName);
+				Material.UVChannelData.bInitialized = true;
+				StaticMaterials.Add(Material);
+				MaterialSlots.Add(SectionMaterial, Section.MaterialIndex);
+			}
 
 #if WITH_EDITOR
 			FMeshSectionInfo SectionInfo;
 			SectionInfo.MaterialIndex = Section.MaterialIndex;
 			StaticMesh->GetSectionInfoMap().Set(LODIndex, SectionIndex, SectionInfo);
 #endif
-
-			const FUnrealSTLConfig& Config = FileLOD.Sections[SectionIndex].Config;
-			FStaticMaterial Material(Config.Material ? Config.Material : UMaterial::GetDefaultMaterial(MD_Surface), *FString::Printf(TEXT("LOD_%u_Section_%u"), LODIndex, SectionIndex));
-			Material.UVChannelData.bInitialized = true;
-			StaticMaterials.Add(Material);
 		}
 
 		LODResources.VertexBuffers.PositionVertexBuffer.Init(STLSectionsPtr->Vertices, StaticMeshConfig.bAllowCPUAccess);
@@ -371,7 +1828,7 @@ UStaticMesh* UUnrealSTLFunctionLibrary::LoadStaticMeshFromSTLFileLODs(const TArr
 		{
 			LODResources.IndexBuffer = FRawStaticIndexBuffer(true);
 		}
-		LODResources.IndexBuffer.SetIndices(STLSectionsPtr->LODIndices, EIndexBufferStride::Force32Bit);
+		LODResources.IndexBuffer.SetIndices(STLSectionsPtr->LODIndices, EIndexBufferStride::AutoDetect);
 
 		if (LODIndex == 0)
 		{
@@ -387,154 +1844,357 @@ UStaticMesh* UUnrealSTLFunctionLibrary::LoadStaticMeshFromSTLFileLODs(const TArr
 
 	StaticMesh->CalculateExtendedBounds();
 
-	return StaticMesh;
+	return true;
 }
 
-bool UUnrealSTLFunctionLibrary::SaveStaticMeshToSTLData(UStaticMesh* StaticMesh, const int32 LOD, FArrayWriter& Writer, const FUnrealSTLConfig& Config)
+bool UUnrealSTLFunctionLibrary::LoadSTLAssembly(const TArray<FUnrealSTLFile>& Files, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, TArray<FUnrealSTLAssemblyPart>& Parts)
 {
-	if (!StaticMesh || LOD < 0)
+	Parts.Empty();
+
+	// the same filename is read and hashed only once
+	TMap<FString, FSHAHash> FilenameHashes;
+	// key is the content hash + the parsing config, value is the index in the Parts array
+	TMap<UnrealSTL::FAssemblyPartKey, int32> PartsMap;
+
+	for (const FUnrealSTLFile& File : Files)
 	{
-		return false;
+		FArrayReader Data;
+		const FSHAHash* CachedHash = FilenameHashes.Find(File.Filename);
+		FSHAHash Hash;
+		if (CachedHash)
+		{
+			Hash = *CachedHash;
+		}
+		else
+		{
+			if (!FFileHelper::LoadFileToArray(Data, *File.Filename))
+			{
+				return false;
+			}
+			FSHA1::HashBuffer(Data.GetData(), Data.Num(), Hash.Hash);
+			FilenameHashes.Add(File.Filename, Hash);
+		}
+
+		const UnrealSTL::FAssemblyPartKey PartKey(Hash, File.Config);
+		if (const int32* PartIndex = PartsMap.Find(PartKey))
+		{
+			Parts[*PartIndex].Transforms.Add(File.Config.Transform);
+			continue;
+		}
+
+		// a previously hashed filename with a different config
+		if (Data.Num() == 0 && !FFileHelper::LoadFileToArray(Data, *File.Filename))
+		{
+			return false;
+		}
+
+		// parts are parsed in their own space, the transform is applied by the instances
+		FUnrealSTLFile PartFile = File;
+		PartFile.Config.Transform = FTransform::Identity;
+
+		TArray<TArray<FUnrealSTLMesh>> STLMeshLODs;
+		FUnrealSTLMesh& STLMesh = STLMeshLODs.AddDefaulted_GetRef().AddDefaulted_GetRef();
+		if (!LoadMeshFromSTLData(Data, PartFile.Config, STLMesh))
+		{
+			return false;
+		}
+
+		FUnrealSTLFileLOD FileLOD;
+		FileLOD.Sections = { PartFile };
+		FileLOD.ScreenSize = 1.0f;
+
+		FUnrealSTLAssemblyPart Part;
+		Part.StaticMesh = LoadStaticMeshFromSTLMeshLODs({ FileLOD }, STLMeshLODs, StaticMeshConfig);
+		if (!Part.StaticMesh)
+		{
+			return false;
+		}
+		Part.Transforms.Add(File.Config.Transform);
+
+		PartsMap.Add(PartKey, Parts.Add(MoveTemp(Part)));
 	}
 
-	if (LOD >= StaticMesh->GetNumLODs())
+	return true;
+}
+
+TArray<UInstancedStaticMeshComponent*> UUnrealSTLFunctionLibrary::AddSTLAssemblyToActor(AActor* Actor, const TArray<FUnrealSTLAssemblyPart>& Parts, const bool bHierarchical)
+{
+	TArray<UInstancedStaticMeshComponent*> Components;
+
+	if (!Actor)
 	{
-		return false;
+		return Components;
 	}
 
-	if (!StaticMesh->GetRenderData())
+	for (const FUnrealSTLAssemblyPart& Part : Parts)
 	{
-		StaticMesh->SetRenderData(MakeUnique<FStaticMeshRenderData>());
+		if (!Part.StaticMesh)
+		{
+			continue;
+		}
+
+		UInstancedStaticMeshComponent* Component = nullptr;
+		if (bHierarchical)
+		{
+			Component = NewObject<UHierarchicalInstancedStaticMeshComponent>(Actor);
+		}
+		else
+		{
+			Component = NewObject<UInstancedStaticMeshComponent>(Actor);
+		}
+
+		Component->SetStaticMesh(Part.StaticMesh);
+
+		if (Actor->GetRootComponent())
+		{
+			Component->SetupAttachment(Actor->GetRootComponent());
+		}
+		else
+		{
+			Actor->SetRootComponent(Component);
+		}
+
+		Component->RegisterComponent();
+		Actor->AddInstanceComponent(Component);
+
+		Component->AddInstances(Part.Transforms, false);
+
+		Components.Add(Component);
 	}
 
-	if (!StaticMesh->GetRenderData()->IsInitialized())
+	return Components;
+}
+
+bool UUnrealSTLFunctionLibrary::SplitSTLMeshIntoChunks(const FUnrealSTLMesh& STLMesh, const int32 MaxVertices, TArray<FUnrealSTLMesh>& Chunks)
+{
+	Chunks.Empty();
+
+	// vertices are not shared between triangles
+	const int32 MaxTriangles = MaxVertices / 3;
+	if (MaxTriangles < 1 || STLMesh.LODIndices.Num() % 3 != 0)
 	{
-		StaticMesh->InitResources();
+		return false;
 	}
 
-	FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
+	const int32 TrianglesNum = STLMesh.LODIndices.Num() / 3;
 
-	FStaticMeshLODResources& LODResources = RenderData->LODResources[LOD];
+	TArray<FVector3f> Centroids;
+	Centroids.AddUninitialized(TrianglesNum);
+	ParallelFor(TrianglesNum, [&STLMesh, &Centroids](const int32 TriangleIndex)
+		{
+			Centroids[TriangleIndex] = (STLMesh.Vertices[STLMesh.LODIndices[TriangleIndex * 3]].Position +
+				STLMesh.Vertices[STLMesh.LODIndices[TriangleIndex * 3 + 1]].Position +
+				STLMesh.Vertices[STLMesh.LODIndices[TriangleIndex * 3 + 2]].Position) / 3.0f;
+		});
 
-	TArray<uint32> Indices;
-	TArray<FVector3f> Vertices;
+	// a node is a range of TriangleIndices, partitioned in place
+	struct FNode
+	{
+		int32 Begin;
+		int32 End;
+	};
 
-#if ENGINE_MAJOR_VERSION < 5
-	if (StaticMesh->bAllowCPUAccess)
-#else
-	if (LODResources.IndexBuffer.GetAllowCPUAccess())
-#endif
+	TArray<int32> TriangleIndices;
+	TriangleIndices.AddUninitialized(TrianglesNum);
+	for (int32 TriangleIndex = 0; TriangleIndex < TrianglesNum; TriangleIndex++)
 	{
-		LODResources.IndexBuffer.GetCopy(Indices);
+		TriangleIndices[TriangleIndex] = TriangleIndex;
 	}
-	else
+
+	TArray<FNode> Leaves;
+	TArray<FNode> Nodes;
+	TArray<FNode> Children;
+
+	auto AddNode = [&Leaves, &Nodes, MaxTriangles](const FNode& Node)
 	{
-		if (LODResources.IndexBuffer.Is32Bit())
+		if (Node.End - Node.Begin > MaxTriangles)
 		{
-#if ENGINE_MAJOR_VERSION < 5
-			void* LockedIndexBuffer = RHILockIndexBuffer(LODResources.IndexBuffer.IndexBufferRHI, 0, LODResources.IndexBuffer.GetNumIndices() * sizeof(uint32), EResourceLockMode::RLM_ReadOnly);
-			if (!LockedIndexBuffer)
+			Nodes.Add(Node);
+		}
+		else if (Node.End > Node.Begin)
+		{
+			Leaves.Add(Node);
+		}
+	};
+
+	AddNode({ 0, TrianglesNum });
+
+	// split along the longest axis of the centroids bounds until each node fits in a chunk,
+	// the nodes of each level are disjoint ranges, so they are split in parallel
+	while (Nodes.Num() > 0)
+	{
+		Children.SetNumUninitialized(Nodes.Num() * 2, UnrealSTL::NoShrinking);
+
+		ParallelFor(Nodes.Num(), [&Nodes, &Children, &TriangleIndices, &Centroids](const int32 NodeIndex)
 			{
-				return false;
-			}
-			Indices.Append(reinterpret_cast<uint32*>(LockedIndexBuffer), LODResources.IndexBuffer.GetNumIndices());
-			RHIUnlockIndexBuffer(LODResources.IndexBuffer.IndexBufferRHI);
-#else
-			UnrealSTL::GPUToCPU(Indices, LODResources.IndexBuffer.IndexBufferRHI, LODResources.IndexBuffer.GetNumIndices());
-#endif
+				const FNode Node = Nodes[NodeIndex];
+
+				FBox CentroidsBox;
+				CentroidsBox.Init();
+				for (int32 Index = Node.Begin; Index < Node.End; Index++)
+				{
+					CentroidsBox += FVector(Centroids[TriangleIndices[Index]]);
+				}
+
+				const FVector Size = CentroidsBox.GetSize();
+				const int32 Axis = Size.X >= Size.Y && Size.X >= Size.Z ? 0 : (Size.Y >= Size.Z ? 1 : 2);
+				const float Middle = CentroidsBox.GetCenter()[Axis];
+
+				int32 Left = Node.Begin;
+				int32 Right = Node.End - 1;
+				while (Left <= Right)
+				{
+					if (Centroids[TriangleIndices[Left]][Axis] < Middle)
+					{
+						Left++;
+					}
+					else
+					{
+						Swap(TriangleIndices[Left], TriangleIndices[Right--]);
+					}
+				}
+
+				// all of the centroids are in the same place, just split the range
+				int32 Split = Left;
+				if (Split == Node.Begin || Split == Node.End)
+				{
+					Split = Node.Begin + (Node.End - Node.Begin) / 2;
+				}
+
+				Children[NodeIndex * 2] = { Node.Begin, Split };
+				Children[NodeIndex * 2 + 1] = { Split, Node.End };
+			});
+
+		Nodes.Reset();
+		for (const FNode& Child : Children)
+		{
+			AddNode(Child);
 		}
-		else
+	}
+
+	Chunks.AddDefaulted(Leaves.Num());
+
+	ParallelFor(Leaves.Num(), [&STLMesh, &Leaves, &TriangleIndices, &Chunks](const int32 ChunkIndex)
 		{
-			TArray<uint16> TmpIndices;
-#if ENGINE_MAJOR_VERSION < 5
-			void* LockedIndexBuffer = RHILockIndexBuffer(LODResources.IndexBuffer.IndexBufferRHI, 0, LODResources.IndexBuffer.GetNumIndices() * sizeof(uint16), EResourceLockMode::RLM_ReadOnly);
-			if (!LockedIndexBuffer)
+			const FNode& Leaf = Leaves[ChunkIndex];
+			const int32 LeafTrianglesNum = Leaf.End - Leaf.Begin;
+			FUnrealSTLMesh& Chunk = Chunks[ChunkIndex];
+			Chunk.Vertices.Reserve(LeafTrianglesNum * 3);
+			Chunk.LODIndices.Reserve(LeafTrianglesNum * 3);
+
+			FBox BoundingBox;
+			BoundingBox.Init();
+
+			for (int32 Index = Leaf.Begin; Index < Leaf.End; Index++)
 			{
-				return false;
+				const int32 TriangleIndex = TriangleIndices[Index];
+				for (int32 Corner = 0; Corner < 3; Corner++)
+				{
+					const FStaticMeshBuildVertex& Vertex = STLMesh.Vertices[STLMesh.LODIndices[TriangleIndex * 3 + Corner]];
+					Chunk.LODIndices.Add(Chunk.Vertices.Num());
+					Chunk.Vertices.Add(Vertex);
+					BoundingBox += FVector(Vertex.Position);
+				}
 			}
-			TmpIndices.Append(reinterpret_cast<uint16*>(LockedIndexBuffer), LODResources.IndexBuffer.GetNumIndices());
-			RHIUnlockIndexBuffer(LODResources.IndexBuffer.IndexBufferRHI);
-#else
-			UnrealSTL::GPUToCPU(TmpIndices, LODResources.IndexBuffer.IndexBufferRHI, LODResources.IndexBuffer.GetNumIndices());
-#endif
-			for (const uint16 Index : TmpIndices)
+
+			BoundingBox.GetCenterAndExtents(Chunk.Bounds.Origin, Chunk.Bounds.BoxExtent);
+			Chunk.Bounds.SphereRadius = 0;
+			for (const FStaticMeshBuildVertex& BuildVertex : Chunk.Vertices)
 			{
-				Indices.Add(Index);
+				Chunk.Bounds.SphereRadius = FMath::Max((BuildVertex.Position - FVector3f(Chunk.Bounds.Origin)).Size(), Chunk.Bounds.SphereRadius);
 			}
-		}
-	}
 
-#if ENGINE_MAJOR_VERSION < 5
-	if (StaticMesh->bAllowCPUAccess)
-#else
-	if (LODResources.VertexBuffers.PositionVertexBuffer.GetAllowCPUAccess())
-#endif
+			Chunk.TrianglesNum = LeafTrianglesNum;
+		});
+
+	return true;
+}
+
+TArray<UStaticMesh*> UUnrealSTLFunctionLibrary::LoadStaticMeshChunksFromSTLFile(const FString& Filename, const FUnrealSTLConfig& Config, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, const int32 MaxVerticesPerChunk)
+{
+	TArray<UStaticMesh*> StaticMeshes;
+
+	// huge files are streamed instead of being loaded in memory
+	FUnrealSTLLoaderContext Context;
+	FUnrealSTLMesh STLMesh;
+	if (!LoadMeshFromSTLFile(Filename, Config, STLMesh, Context))
 	{
-		for (uint32 VertexIndex = 0; VertexIndex < LODResources.VertexBuffers.PositionVertexBuffer.GetNumVertices(); VertexIndex++)
-		{
-			Vertices.Add(LODResources.VertexBuffers.PositionVertexBuffer.VertexPosition(VertexIndex));
-		}
+		return StaticMeshes;
 	}
-	else
+
+	TArray<FUnrealSTLMesh> Chunks;
+	if (!SplitSTLMeshIntoChunks(STLMesh, MaxVerticesPerChunk, Chunks))
 	{
-#if ENGINE_MAJOR_VERSION < 5
-		void* LockedVertexBuffer = RHILockVertexBuffer(LODResources.VertexBuffers.PositionVertexBuffer.VertexBufferRHI, 0, LODResources.VertexBuffers.PositionVertexBuffer.GetNumVertices() * sizeof(FVector), EResourceLockMode::RLM_ReadOnly);
-		if (!LockedVertexBuffer)
-		{
-			return false;
-		}
-		Vertices.Append(reinterpret_cast<FVector*>(LockedVertexBuffer), LODResources.VertexBuffers.PositionVertexBuffer.GetNumVertices());
-		RHIUnlockVertexBuffer(LODResources.VertexBuffers.PositionVertexBuffer.VertexBufferRHI);
-#else
-		UnrealSTL::GPUToCPU(Vertices, LODResources.VertexBuffers.PositionVertexBuffer.VertexBufferRHI, LODResources.VertexBuffers.PositionVertexBuffer.GetNumVertices());
-#endif
+		return StaticMeshes;
 	}
 
-	TArray<uint8> Header;
-	Header.AddZeroed(UnrealSTL::BinaryHeaderSize);
-
-	const int32 SolidNameLen = FCStringAnsi::Strlen(TCHAR_TO_ANSI(*StaticMesh->GetFullName()));
-	FMemory::Memcpy(Header.GetData(), TCHAR_TO_ANSI(*StaticMesh->GetFullName()), FMath::Min(UnrealSTL::BinaryHeaderSize, SolidNameLen));
+	FUnrealSTLFile STLFile;
+	STLFile.Filename = Filename;
+	STLFile.Config = Config;
 
-	Writer.Append(Header);
-	Writer.Seek(UnrealSTL::BinaryHeaderSize);
+	FUnrealSTLFileLOD STLFileLOD;
+	STLFileLOD.Sections = { STLFile };
+	STLFileLOD.ScreenSize = 1.0f;
 
-	uint32 NumTriangles = Indices.Num() / 3;
-	Writer << NumTriangles;
-	for (uint32 TriangleIndex = 0; TriangleIndex < NumTriangles; TriangleIndex++)
+	for (FUnrealSTLMesh& Chunk : Chunks)
 	{
-		uint32 VertexIndex1 = Indices[TriangleIndex * 3];
-		uint32 VertexIndex2 = Indices[TriangleIndex * 3 + 1];
-		uint32 VertexIndex3 = Indices[TriangleIndex * 3 + 2];
-		if (Config.bReverseWinding)
+		TArray<TArray<FUnrealSTLMesh>> STLMeshLODs;
+		STLMeshLODs.AddDefaulted_GetRef().Add(MoveTemp(Chunk));
+		UStaticMesh* StaticMesh = LoadStaticMeshFromSTLMeshLODs({ STLFileLOD }, STLMeshLODs, StaticMeshConfig);
+		if (!StaticMesh)
 		{
-			Swap(VertexIndex2, VertexIndex3);
+			return TArray<UStaticMesh*>();
 		}
-		const FVector3f NegateX = FVector3f(-1, 1, 1);
-		FVector3f Vertex1 = FVector3f(Config.Transform.TransformPosition(FVector(Vertices[VertexIndex1]))) * NegateX;
-		FVector3f Vertex2 = FVector3f(Config.Transform.TransformPosition(FVector(Vertices[VertexIndex2]))) * NegateX;
-		FVector3f Vertex3 = FVector3f(Config.Transform.TransformPosition(FVector(Vertices[VertexIndex3]))) * NegateX;
-		FVector3f Normal = FVector3f::CrossProduct(Vertex3 - Vertex1, Vertex2 - Vertex1).GetSafeNormal();
-
-		uint16 Attributes = 0;
-
-		Writer << Normal;
-		Writer << Vertex1;
-		Writer << Vertex2;
-		Writer << Vertex3;
-		Writer << Attributes;
+		StaticMeshes.Add(StaticMesh);
 	}
 
-	return true;
+	return StaticMeshes;
+}
+
+bool UUnrealSTLFunctionLibrary::SaveStaticMeshToSTLData(UStaticMesh* StaticMesh, const int32 LOD, FArrayWriter& Writer, const FUnrealSTLConfig& Config)
+{
+	UnrealSTL::FStreamWriter StreamWriter(Writer, false);
+	const bool bWritten = UnrealSTL::WriteStaticMesh(StaticMesh, LOD, Config, StreamWriter);
+	return StreamWriter.Close() && bWritten;
 }
 
 bool UUnrealSTLFunctionLibrary::SaveStaticMeshToSTLFile(UStaticMesh* StaticMesh, const int32 LOD, const FString& Filename, const FUnrealSTLConfig& Config)
 {
-	FArrayWriter Writer;
-	if (!SaveStaticMeshToSTLData(StaticMesh, LOD, Writer, Config))
+	return UnrealSTL::SaveToFile(Filename, [&](UnrealSTL::FStreamWriter& Writer)
+		{
+			return UnrealSTL::WriteStaticMesh(StaticMesh, LOD, Config, Writer);
+		});
+}
+
+bool UUnrealSTLFunctionLibrary::SaveStaticMeshComponentsToSTLFile(const TArray<UStaticMeshComponent*>& Components, const int32 LOD, const FString& Filename, const FUnrealSTLConfig& Config)
+{
+	return UnrealSTL::SaveToFile(Filename, [&](UnrealSTL::FStreamWriter& Writer)
+		{
+			return UnrealSTL::WriteStaticMeshComponents(Components, LOD, Config, Writer);
+		});
+}
+
+bool UUnrealSTLFunctionLibrary::SaveWorldToSTLFile(UObject* WorldContextObject, const int32 LOD, const FString& Filename, const FUnrealSTLConfig& Config)
+{
+	UWorld* World = GEngine ? GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::ReturnNull) : nullptr;
+	if (!World)
 	{
 		return false;
 	}
 
-	return FFileHelper::SaveArrayToFile(Writer, *Filename);
+	TArray<UStaticMeshComponent*> Components;
+	for (TActorIterator<AActor> It(World); It; ++It)
+	{
+		TArray<UStaticMeshComponent*> ActorComponents;
+		It->GetComponents(ActorComponents);
+		for (UStaticMeshComponent* Component : ActorComponents)
+		{
+			if (Component->IsRegistered() && Component->IsVisible())
+			{
+				Components.Add(Component);
+			}
+		}
+	}
+
+	return SaveStaticMeshComponentsToSTLFile(Components, LOD, Filename, Config);
 }
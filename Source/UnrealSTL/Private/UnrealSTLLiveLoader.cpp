@@ -0,0 +1,181 @@
+// Copyright 2022, Roberto De Ioris.
+
+#include "UnrealSTLLiveLoader.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+
+UUnrealSTLLiveLoader::UUnrealSTLLiveLoader()
+{
+	PollInterval = 1.0f;
+	StaticMesh = nullptr;
+	TimeSinceLastPoll = 0;
+}
+
+UUnrealSTLLiveLoader* UUnrealSTLLiveLoader::CreateSTLLiveLoader(const TArray<FUnrealSTLFileLOD>& FileLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, const float PollInterval)
+{
+	if (FileLODs.Num() < 1)
+	{
+		return nullptr;
+	}
+
+	UUnrealSTLLiveLoader* LiveLoader = NewObject<UUnrealSTLLiveLoader>(StaticMeshConfig.Outer ? StaticMeshConfig.Outer : GetTransientPackage());
+	LiveLoader->FileLODs = FileLODs;
+	LiveLoader->StaticMeshConfig = StaticMeshConfig;
+	LiveLoader->PollInterval = PollInterval;
+
+	for (const FUnrealSTLFileLOD& FileLOD : FileLODs)
+	{
+		LiveLoader->STLMeshLODs.AddDefaulted_GetRef().AddDefaulted(FileLOD.Sections.Num());
+		LiveLoader->WatchedFileLODs.AddDefaulted_GetRef().AddDefaulted(FileLOD.Sections.Num());
+	}
+
+	// the first poll loads everything
+	if (!LiveLoader->Poll())
+	{
+		return nullptr;
+	}
+
+	LiveLoader->StartWatching();
+
+	return LiveLoader;
+}
+
+UStaticMesh* UUnrealSTLLiveLoader::GetStaticMesh() const
+{
+	return StaticMesh;
+}
+
+bool UUnrealSTLLiveLoader::Poll()
+{
+	IFileManager& FileManager = IFileManager::Get();
+
+	bool bChanged = false;
+	bool bComplete = true;
+
+	for (int32 LODIndex = 0; LODIndex < FileLODs.Num(); LODIndex++)
+	{
+		for (int32 SectionIndex = 0; SectionIndex < FileLODs[LODIndex].Sections.Num(); SectionIndex++)
+		{
+			const FUnrealSTLFile& File = FileLODs[LODIndex].Sections[SectionIndex];
+			FWatchedFile& WatchedFile = WatchedFileLODs[LODIndex][SectionIndex];
+
+			const FDateTime Timestamp = FileManager.GetTimeStamp(*File.Filename);
+			const int64 Size = FileManager.FileSize(*File.Filename);
+			if (WatchedFile.bLoaded && Timestamp == WatchedFile.Timestamp && Size == WatchedFile.Size)
+			{
+				continue;
+			}
+
+			FArrayReader Data;
+			if (Size < 0 || !FFileHelper::LoadFileToArray(Data, *File.Filename))
+			{
+				bComplete = WatchedFile.bLoaded && bComplete;
+				continue;
+			}
+
+			FSHAHash Hash;
+			FSHA1::HashBuffer(Data.GetData(), Data.Num(), Hash.Hash);
+
+			// touched but not modified
+			if (WatchedFile.bLoaded && Hash == WatchedFile.Hash)
+			{
+				WatchedFile.Timestamp = Timestamp;
+				WatchedFile.Size = Size;
+				continue;
+			}
+
+			// the file could be still in the process of being written, timestamp is not updated so it will be retried
+			FUnrealSTLMesh STLMesh;
+			if (!UUnrealSTLFunctionLibrary::LoadMeshFromSTLData(Data, File.Config, STLMesh))
+			{
+				bComplete = WatchedFile.bLoaded && bComplete;
+				continue;
+			}
+
+			STLMeshLODs[LODIndex][SectionIndex] = MoveTemp(STLMesh);
+			WatchedFile.Timestamp = Timestamp;
+			WatchedFile.Size = Size;
+			WatchedFile.Hash = Hash;
+			WatchedFile.bLoaded = true;
+			bChanged = true;
+		}
+	}
+
+	// the StaticMesh is built only when all of the sections have been loaded at least once
+	if (!bChanged || !bComplete)
+	{
+		return false;
+	}
+
+	if (!StaticMesh)
+	{
+		StaticMesh = UUnrealSTLFunctionLibrary::LoadStaticMeshFromSTLMeshLODs(FileLODs, STLMeshLODs, StaticMeshConfig);
+		if (!StaticMesh)
+		{
+			return false;
+		}
+	}
+	else if (!UUnrealSTLFunctionLibrary::UpdateStaticMeshFromSTLMeshLODs(StaticMesh, FileLODs, STLMeshLODs, StaticMeshConfig))
+	{
+		return false;
+	}
+
+	OnReloaded.Broadcast(StaticMesh);
+
+	return true;
+}
+
+void UUnrealSTLLiveLoader::StartWatching()
+{
+	if (TickerHandle.IsValid())
+	{
+		return;
+	}
+
+	TimeSinceLastPoll = 0;
+
+	// the ticker delegate is weak, keep the loader alive while watching even if nothing references it
+	AddToRoot();
+
+#if ENGINE_MAJOR_VERSION > 4
+	TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UUnrealSTLLiveLoader::Tick));
+#else
+	TickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UUnrealSTLLiveLoader::Tick));
+#endif
+}
+
+void UUnrealSTLLiveLoader::StopWatching()
+{
+	if (!TickerHandle.IsValid())
+	{
+		return;
+	}
+
+#if ENGINE_MAJOR_VERSION > 4
+	FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+#else
+	FTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+#endif
+	TickerHandle.Reset();
+
+	RemoveFromRoot();
+}
+
+bool UUnrealSTLLiveLoader::Tick(float DeltaTime)
+{
+	TimeSinceLastPoll += DeltaTime;
+	if (TimeSinceLastPoll >= PollInterval)
+	{
+		TimeSinceLastPoll = 0;
+		Poll();
+	}
+
+	return true;
+}
+
+void UUnrealSTLLiveLoader::BeginDestroy()
+{
+	StopWatching();
+
+	Super::BeginDestroy();
+}
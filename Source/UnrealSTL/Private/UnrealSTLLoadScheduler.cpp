@@ -0,0 +1,205 @@
+// Copyright 2022, Roberto De Ioris.
+
+#include "UnrealSTLLoadScheduler.h"
+#include "Async/Async.h"
+
+UUnrealSTLLoadScheduler::UUnrealSTLLoadScheduler()
+{
+	MemoryBudget = 512 * 1024 * 1024;
+	MemoryInUse = 0;
+	NextLoadId = 0;
+}
+
+UUnrealSTLLoadScheduler* UUnrealSTLLoadScheduler::CreateSTLLoadScheduler(const int64 MemoryBudget)
+{
+	UUnrealSTLLoadScheduler* LoadScheduler = NewObject<UUnrealSTLLoadScheduler>();
+	LoadScheduler->MemoryBudget = MemoryBudget;
+	return LoadScheduler;
+}
+
+bool UUnrealSTLLoadScheduler::EnqueueLoad(const TArray<FUnrealSTLFileLOD>& FileLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, const FUnrealSTLLoadCompleted& OnCompleted)
+{
+	if (FileLODs.Num() < 1)
+	{
+		return false;
+	}
+
+	const int32 LoadId = NextLoadId++;
+
+	FUnrealSTLScheduledLoad ScheduledLoad;
+	ScheduledLoad.FileLODs = FileLODs;
+	ScheduledLoad.StaticMeshConfig = StaticMeshConfig;
+	ScheduledLoad.OnCompleted = OnCompleted;
+	ScheduledLoad.LoadId = LoadId;
+
+	PendingLoads.Add(MoveTemp(ScheduledLoad));
+
+	// probing ASCII files scans them completely, so it runs in the background too
+	TWeakObjectPtr<UUnrealSTLLoadScheduler> WeakThis = this;
+	Async(EAsyncExecution::ThreadPool, [WeakThis, LoadId, FileLODs]()
+		{
+			int64 EstimatedMemory = 0;
+			bool bSuccess = true;
+			for (const FUnrealSTLFileLOD& FileLOD : FileLODs)
+			{
+				int64 LODTrianglesNum = 0;
+				for (const FUnrealSTLFile& File : FileLOD.Sections)
+				{
+					FUnrealSTLProbe Probe;
+					if (!UUnrealSTLFunctionLibrary::ProbeSTLFile(File.Filename, File.Config, false, Probe))
+					{
+						bSuccess = false;
+						break;
+					}
+					EstimatedMemory += Probe.EstimatedCPUMemory + Probe.EstimatedGPUMemory;
+					LODTrianglesNum += Probe.TrianglesNum;
+				}
+
+				if (!bSuccess)
+				{
+					break;
+				}
+
+				// multiple sections are merged in a copy of their vertices and indices
+				if (FileLOD.Sections.Num() > 1)
+				{
+					EstimatedMemory += LODTrianglesNum * 3 * (sizeof(FStaticMeshBuildVertex) + sizeof(uint32));
+				}
+			}
+
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, LoadId, EstimatedMemory, bSuccess]()
+				{
+					if (WeakThis.IsValid())
+					{
+						WeakThis->Probed(LoadId, EstimatedMemory, bSuccess);
+					}
+				});
+		});
+
+	return true;
+}
+
+int64 UUnrealSTLLoadScheduler::GetMemoryInUse() const
+{
+	return MemoryInUse;
+}
+
+int32 UUnrealSTLLoadScheduler::GetPendingLoadsNum() const
+{
+	return PendingLoads.Num();
+}
+
+int32 UUnrealSTLLoadScheduler::GetRunningLoadsNum() const
+{
+	return RunningLoads.Num();
+}
+
+void UUnrealSTLLoadScheduler::Pump()
+{
+	// loads are admitted in order, so big ones cannot starve
+	while (PendingLoads.Num() > 0)
+	{
+		// waiting for the probe
+		if (!PendingLoads[0].bProbed)
+		{
+			return;
+		}
+
+		if (RunningLoads.Num() > 0 && MemoryInUse + PendingLoads[0].EstimatedMemory > MemoryBudget)
+		{
+			return;
+		}
+
+		FUnrealSTLScheduledLoad& ScheduledLoad = RunningLoads.Add_GetRef(MoveTemp(PendingLoads[0]));
+		PendingLoads.RemoveAt(0);
+
+		MemoryInUse += ScheduledLoad.EstimatedMemory;
+
+		TWeakObjectPtr<UUnrealSTLLoadScheduler> WeakThis = this;
+		Async(EAsyncExecution::ThreadPool, [WeakThis, LoadId = ScheduledLoad.LoadId, FileLODs = ScheduledLoad.FileLODs]()
+			{
+				// parsing only, UObjects are created on the game thread
+				TArray<TArray<FUnrealSTLMesh>> STLMeshLODs;
+				bool bSuccess = true;
+				for (const FUnrealSTLFileLOD& FileLOD : FileLODs)
+				{
+					TArray<FUnrealSTLMesh>& STLMeshes = STLMeshLODs.AddDefaulted_GetRef();
+					for (const FUnrealSTLFile& File : FileLOD.Sections)
+					{
+						if (!UUnrealSTLFunctionLibrary::LoadMeshFromSTLFile(File.Filename, File.Config, STLMeshes.AddDefaulted_GetRef(), FUnrealSTLLoaderContext::GetForCurrentThread()))
+						{
+							bSuccess = false;
+							break;
+						}
+					}
+
+					if (!bSuccess)
+					{
+						break;
+					}
+				}
+
+				// pool threads live for the whole process, do not keep the buffers of huge files around
+				FUnrealSTLLoaderContext::GetForCurrentThread().Trim();
+
+				AsyncTask(ENamedThreads::GameThread, [WeakThis, LoadId, STLMeshLODs = MoveTemp(STLMeshLODs), bSuccess]() mutable
+					{
+						if (WeakThis.IsValid())
+						{
+							WeakThis->Complete(LoadId, MoveTemp(STLMeshLODs), bSuccess);
+						}
+					});
+			});
+	}
+}
+
+void UUnrealSTLLoadScheduler::Probed(const int32 LoadId, const int64 EstimatedMemory, const bool bSuccess)
+{
+	const int32 LoadIndex = PendingLoads.IndexOfByPredicate([LoadId](const FUnrealSTLScheduledLoad& ScheduledLoad) { return ScheduledLoad.LoadId == LoadId; });
+	if (LoadIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	if (bSuccess)
+	{
+		PendingLoads[LoadIndex].EstimatedMemory = EstimatedMemory;
+		PendingLoads[LoadIndex].bProbed = true;
+	}
+	else
+	{
+		const FUnrealSTLLoadCompleted OnCompleted = PendingLoads[LoadIndex].OnCompleted;
+		PendingLoads.RemoveAt(LoadIndex);
+		OnCompleted.ExecuteIfBound(nullptr);
+	}
+
+	Pump();
+}
+
+void UUnrealSTLLoadScheduler::Complete(const int32 LoadId, TArray<TArray<FUnrealSTLMesh>>&& STLMeshLODs, const bool bSuccess)
+{
+	const int32 LoadIndex = RunningLoads.IndexOfByPredicate([LoadId](const FUnrealSTLScheduledLoad& ScheduledLoad) { return ScheduledLoad.LoadId == LoadId; });
+	if (LoadIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	FUnrealSTLScheduledLoad ScheduledLoad = MoveTemp(RunningLoads[LoadIndex]);
+	RunningLoads.RemoveAt(LoadIndex);
+
+	UStaticMesh* StaticMesh = nullptr;
+	if (bSuccess)
+	{
+		FUnrealSTLLoaderContext& Context = FUnrealSTLLoaderContext::GetForCurrentThread();
+		StaticMesh = UUnrealSTLFunctionLibrary::LoadStaticMeshFromSTLMeshLODs(ScheduledLoad.FileLODs, STLMeshLODs, ScheduledLoad.StaticMeshConfig, Context);
+		Context.Trim();
+	}
+
+	// the parsed data is released, GPU memory is not tracked anymore
+	STLMeshLODs.Empty();
+	MemoryInUse -= ScheduledLoad.EstimatedMemory;
+
+	ScheduledLoad.OnCompleted.ExecuteIfBound(StaticMesh);
+
+	Pump();
+}
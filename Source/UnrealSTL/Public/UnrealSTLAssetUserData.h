@@ -0,0 +1,26 @@
+// Copyright 2022, Roberto De Ioris.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/AssetUserData.h"
+#include "UnrealSTLFunctionLibrary.h"
+#include "UnrealSTLAssetUserData.generated.h"
+
+/**
+ * Added by the editor importer to the generated StaticMesh: runtime loads (FUnrealSTLStaticMeshConfig::CookedContentPath)
+ * use the asset only if it has been built from the same file content with the same config.
+ */
+UCLASS()
+class UNREALSTL_API UUnrealSTLAssetUserData : public UAssetUserData
+{
+	GENERATED_BODY()
+
+public:
+	/** SHA1 of the source file (as stored on disk, eventually compressed) */
+	UPROPERTY(VisibleAnywhere, Category = "UnrealSTL")
+	FString SourceHash;
+
+	UPROPERTY(VisibleAnywhere, Category = "UnrealSTL")
+	FUnrealSTLConfig Config;
+};
@@ -6,6 +6,7 @@
 #include "Kismet/BlueprintFunctionLibrary.h"
 #include "Serialization/ArrayReader.h"
 #include "Serialization/ArrayWriter.h"
+#include "Components/InstancedStaticMeshComponent.h"
 #include "UnrealSTLFunctionLibrary.generated.h"
 
 #if ENGINE_MAJOR_VERSION < 5
@@ -20,8 +21,68 @@ struct UNREALSTL_API FUnrealSTLMesh
 	FBoxSphereBounds Bounds;
 	TArray<FStaticMeshSection> Sections;
 
+	/** facets removed (or fixed) by FUnrealSTLConfig::bCleanupFacets */
+	uint32 DegenerateFacetsNum;
+	uint32 DuplicateFacetsNum;
+	uint32 InvalidFacetsNum;
+	uint32 RepairedNormalsNum;
+
 	FUnrealSTLMesh();
 	FUnrealSTLMesh(const TArray<FUnrealSTLMesh>& Meshes);
+	/** each group of meshes becomes a single section */
+	FUnrealSTLMesh(const TArray<TArray<const FUnrealSTLMesh*>>& MeshGroups);
+
+	/** like the MeshGroups constructor, but reusing the already allocated memory */
+	void Merge(const TArray<TArray<const FUnrealSTLMesh*>>& MeshGroups);
+};
+
+struct UNREALSTL_API FUnrealSTLFacetKey
+{
+	FVector3f Positions[3];
+
+	bool operator==(const FUnrealSTLFacetKey& Other) const
+	{
+		return !FMemory::Memcmp(Positions, Other.Positions, sizeof(Positions));
+	}
+
+	friend uint32 GetTypeHash(const FUnrealSTLFacetKey& Key)
+	{
+		return FCrc::MemCrc32(Key.Positions, sizeof(Key.Positions));
+	}
+};
+
+/**
+ * Reusable buffers for loading STL files: once warmed up, parsing does not allocate memory anymore.
+ * A context cannot be shared between concurrent loads, use GetForCurrentThread() for a per-thread one
+ * (and Trim() it after loading huge files).
+ */
+struct UNREALSTL_API FUnrealSTLLoaderContext
+{
+	/** blocks of the file being read */
+	TArray<uint8> ReadBlock;
+
+	/** blocks of decompressed data (for compressed files) */
+	TArray<uint8> DecompressedBlock;
+
+	/** parsed meshes (one array per LOD) */
+	TArray<TArray<FUnrealSTLMesh>> STLMeshLODs;
+
+	/** facets hashes (for bCleanupFacets) */
+	TSet<FUnrealSTLFacetKey> Facets;
+
+	/** merged sections of a LOD (when building a StaticMesh from multiple files) */
+	FUnrealSTLMesh MergedSections;
+
+	FUnrealSTLLoaderContext() = default;
+	UE_NONCOPYABLE(FUnrealSTLLoaderContext);
+
+	/** frees the memory of the buffers */
+	void Empty();
+
+	/** frees only the buffers grown over MaxRetainedSize bytes (so a single huge load does not pin memory forever) */
+	void Trim(const int64 MaxRetainedSize = 64 * 1024 * 1024);
+
+	static FUnrealSTLLoaderContext& GetForCurrentThread();
 };
 
 UENUM()
@@ -49,12 +110,65 @@ struct FUnrealSTLConfig
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UnrealSTL")
 	UMaterialInterface* Material;
 
+	/** Discards degenerate, duplicated and NaN/Inf facets, and recomputes zero or inconsistent normals */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UnrealSTL")
+	bool bCleanupFacets;
+
 	FUnrealSTLConfig()
 	{
 		Transform = FTransform::Identity;
 		FileMode = EUnrealSTLFileMode::Auto;
 		bReverseWinding = false;
 		Material = nullptr;
+		bCleanupFacets = false;
+	}
+};
+
+USTRUCT(BlueprintType)
+struct FUnrealSTLProbe
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "UnrealSTL")
+	EUnrealSTLFileMode FileMode;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "UnrealSTL")
+	bool bCompressed;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "UnrealSTL")
+	int64 FileSize;
+
+	/** exact for binary files (clamped to the file size), estimated for ASCII ones */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "UnrealSTL")
+	int64 TrianglesNum;
+
+	/** false if the binary header reports more triangles than the file can contain */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "UnrealSTL")
+	bool bHeaderValid;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "UnrealSTL")
+	int64 EstimatedCPUMemory;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "UnrealSTL")
+	int64 EstimatedGPUMemory;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "UnrealSTL")
+	bool bHasBounds;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "UnrealSTL")
+	FBox Bounds;
+
+	FUnrealSTLProbe()
+	{
+		FileMode = EUnrealSTLFileMode::Auto;
+		bCompressed = false;
+		FileSize = 0;
+		TrianglesNum = 0;
+		bHeaderValid = false;
+		EstimatedCPUMemory = 0;
+		EstimatedGPUMemory = 0;
+		bHasBounds = false;
+		Bounds.Init();
 	}
 };
 
@@ -69,10 +183,24 @@ struct FUnrealSTLStaticMeshConfig
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UnrealSTL")
 	UObject* Outer;
 
+	/** Files sharing the same Material are merged in a single section (and material slots are reused between LODs) */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UnrealSTL")
+	bool bMergeSectionsByMaterial;
+
+	/**
+	 * If set (e.g. "/Game/STL"), single file loads first look for a cooked StaticMesh asset named after the STL file in this path
+	 * (generated by the editor importer, e.g. with Nanite enabled), and parse the STL file only if it is not found or if it has
+	 * not been imported from the same file content with the same FUnrealSTLConfig (Outer must be null).
+	 * The returned asset is shared: it must not be modified.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UnrealSTL")
+	FString CookedContentPath;
+
 	FUnrealSTLStaticMeshConfig()
 	{
 		bAllowCPUAccess = false;
 		Outer = nullptr;
+		bMergeSectionsByMaterial = false;
 	}
 };
 
@@ -105,6 +233,24 @@ struct FUnrealSTLFileLOD
 	}
 };
 
+USTRUCT(BlueprintType)
+struct FUnrealSTLAssemblyPart
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UnrealSTL")
+	UStaticMesh* StaticMesh;
+
+	/** one entry for each occurrence of the part in the assembly (from FUnrealSTLConfig::Transform) */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UnrealSTL")
+	TArray<FTransform> Transforms;
+
+	FUnrealSTLAssemblyPart()
+	{
+		StaticMesh = nullptr;
+	}
+};
+
 /**
  * 
  */
@@ -116,15 +262,68 @@ class UNREALSTL_API UUnrealSTLFunctionLibrary : public UBlueprintFunctionLibrary
 public:
 
 	static bool LoadMeshFromSTLData(FArrayReader& Reader, const FUnrealSTLConfig& Config, FUnrealSTLMesh& STLMesh);
+	static bool LoadMeshFromSTLData(FArrayReader& Reader, const FUnrealSTLConfig& Config, FUnrealSTLMesh& STLMesh, FUnrealSTLLoaderContext& Context);
+	static bool LoadMeshFromSTLFile(const FString& Filename, const FUnrealSTLConfig& Config, FUnrealSTLMesh& STLMesh, FUnrealSTLLoaderContext& Context);
 	static bool SaveStaticMeshToSTLData(UStaticMesh* StaticMesh, const int32 LOD, FArrayWriter& Writer, const FUnrealSTLConfig& Config);
 
 	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "Config"), Category = "UnrealSTL")
 	static bool SaveStaticMeshToSTLFile(UStaticMesh* StaticMesh, const int32 LOD, const FString& Filename, const FUnrealSTLConfig& Config);
 
+	/**
+	 * Exports multiple (instanced) StaticMeshComponents with their world transforms in a single file (compressed if Filename ends with .gz).
+	 * The geometry of each StaticMesh is fetched only once and the instances are transformed in parallel.
+	 * Editor-only components (or components of editor-only Actors) and components hidden in game are skipped.
+	 */
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "Config"), Category = "UnrealSTL")
+	static bool SaveStaticMeshComponentsToSTLFile(const TArray<UStaticMeshComponent*>& Components, const int32 LOD, const FString& Filename, const FUnrealSTLConfig& Config);
+
+	/** Exports every visible (and not editor-only or hidden in game) StaticMeshComponent of the World in a single file */
+	UFUNCTION(BlueprintCallable, meta = (WorldContext = "WorldContextObject", AutoCreateRefTerm = "Config"), Category = "UnrealSTL")
+	static bool SaveWorldToSTLFile(UObject* WorldContextObject, const int32 LOD, const FString& Filename, const FUnrealSTLConfig& Config);
+
 	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "Config, StaticMeshConfig"), Category="UnrealSTL")
     static UStaticMesh* LoadStaticMeshFromSTLFile(const FString& Filename, const FUnrealSTLConfig& Config, const FUnrealSTLStaticMeshConfig& StaticMeshConfig);
 
 	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "StaticMeshConfig"), Category = "UnrealSTL")
 	static UStaticMesh* LoadStaticMeshFromSTLFileLODs(const TArray<FUnrealSTLFileLOD>& FileLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig);
+
+	/**
+	 * Returns format, triangles and memory estimations of a file by reading only its header (binary) or scanning its newlines (ASCII).
+	 * Computing the bounds requires reading the whole file (but without storing the vertices).
+	 */
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "Config"), Category = "UnrealSTL")
+	static bool ProbeSTLFile(const FString& Filename, const FUnrealSTLConfig& Config, const bool bComputeBounds, FUnrealSTLProbe& Probe);
+
+	/** Like LoadStaticMeshFromSTLFileLODs but reusing the buffers of the Context (useful when loading lot of files) */
+	static UStaticMesh* LoadStaticMeshFromSTLFileLODsWithContext(const TArray<FUnrealSTLFileLOD>& FileLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, FUnrealSTLLoaderContext& Context);
+
+	/** Builds a StaticMesh from already parsed meshes (one array of meshes per LOD, one mesh per FUnrealSTLFile section) */
+	static UStaticMesh* LoadStaticMeshFromSTLMeshLODs(const TArray<FUnrealSTLFileLOD>& FileLODs, const TArray<TArray<FUnrealSTLMesh>>& STLMeshLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig);
+	static UStaticMesh* LoadStaticMeshFromSTLMeshLODs(const TArray<FUnrealSTLFileLOD>& FileLODs, const TArray<TArray<FUnrealSTLMesh>>& STLMeshLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, FUnrealSTLLoaderContext& Context);
+
+	/** Replaces the render data (and the materials) of an already existing StaticMesh, components using it are updated */
+	static bool UpdateStaticMeshFromSTLMeshLODs(UStaticMesh* StaticMesh, const TArray<FUnrealSTLFileLOD>& FileLODs, const TArray<TArray<FUnrealSTLMesh>>& STLMeshLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig);
+	static bool UpdateStaticMeshFromSTLMeshLODs(UStaticMesh* StaticMesh, const TArray<FUnrealSTLFileLOD>& FileLODs, const TArray<TArray<FUnrealSTLMesh>>& STLMeshLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, FUnrealSTLLoaderContext& Context);
+
+	/**
+	 * Loads an assembly of (potentially repeated) parts: files with the same content (and the same FileMode, bReverseWinding, bCleanupFacets and Material)
+	 * are parsed only once and their FUnrealSTLConfig::Transform become instances of the same StaticMesh.
+	 */
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "StaticMeshConfig"), Category = "UnrealSTL")
+	static bool LoadSTLAssembly(const TArray<FUnrealSTLFile>& Files, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, TArray<FUnrealSTLAssemblyPart>& Parts);
+
+	/** Creates an (Hierarchical)InstancedStaticMeshComponent for each part of the assembly, attached to the root of the Actor */
+	UFUNCTION(BlueprintCallable, Category = "UnrealSTL")
+	static TArray<UInstancedStaticMeshComponent*> AddSTLAssemblyToActor(AActor* Actor, const TArray<FUnrealSTLAssemblyPart>& Parts, const bool bHierarchical);
+
+	/** Spatially splits a mesh (kd-tree style) in chunks of at most MaxVertices vertices, sections are ignored */
+	static bool SplitSTLMeshIntoChunks(const FUnrealSTLMesh& STLMesh, const int32 MaxVertices, TArray<FUnrealSTLMesh>& Chunks);
+
+	/**
+	 * Loads a huge STL file as multiple StaticMeshes (one for each spatial chunk, to be assigned to different components) with tight bounds.
+	 * Chunks of at most 65535 vertices use 16 bit indices.
+	 */
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "Config, StaticMeshConfig"), Category = "UnrealSTL")
+	static TArray<UStaticMesh*> LoadStaticMeshChunksFromSTLFile(const FString& Filename, const FUnrealSTLConfig& Config, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, const int32 MaxVerticesPerChunk = 65535);
 	
 };
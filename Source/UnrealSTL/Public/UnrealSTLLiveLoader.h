@@ -0,0 +1,91 @@
+// Copyright 2022, Roberto De Ioris.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Misc/SecureHash.h"
+#include "UnrealSTLFunctionLibrary.h"
+#include "UnrealSTLLiveLoader.generated.h"
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FUnrealSTLLiveLoaderReloaded, UStaticMesh*, StaticMesh);
+
+/**
+ * Keeps a StaticMesh in sync with its STL files: files are polled (timestamp, size and content hash)
+ * and only the changed sections are parsed again, while the others are reused from the cache.
+ */
+UCLASS(BlueprintType)
+class UNREALSTL_API UUnrealSTLLiveLoader : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UUnrealSTLLiveLoader();
+
+	/** The returned loader is already watching the files (call StopWatching when done with it) */
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "StaticMeshConfig"), Category = "UnrealSTL")
+	static UUnrealSTLLiveLoader* CreateSTLLiveLoader(const TArray<FUnrealSTLFileLOD>& FileLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, const float PollInterval = 1.0f);
+
+	UFUNCTION(BlueprintPure, Category = "UnrealSTL")
+	UStaticMesh* GetStaticMesh() const;
+
+	/** Checks the files immediately, returns true if the StaticMesh has been updated */
+	UFUNCTION(BlueprintCallable, Category = "UnrealSTL")
+	bool Poll();
+
+	/** The loader is rooted (kept alive even without references) while watching */
+	UFUNCTION(BlueprintCallable, Category = "UnrealSTL")
+	void StartWatching();
+
+	/** Must be called (e.g. in EndPlay) for releasing a loader that is watching */
+	UFUNCTION(BlueprintCallable, Category = "UnrealSTL")
+	void StopWatching();
+
+	UPROPERTY(BlueprintAssignable, Category = "UnrealSTL")
+	FUnrealSTLLiveLoaderReloaded OnReloaded;
+
+	/** Seconds between file checks */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UnrealSTL")
+	float PollInterval;
+
+	virtual void BeginDestroy() override;
+
+protected:
+	struct FWatchedFile
+	{
+		FDateTime Timestamp;
+		int64 Size;
+		FSHAHash Hash;
+		bool bLoaded;
+
+		FWatchedFile()
+		{
+			Timestamp = FDateTime::MinValue();
+			Size = -1;
+			bLoaded = false;
+		}
+	};
+
+	bool Tick(float DeltaTime);
+
+	UPROPERTY()
+	TArray<FUnrealSTLFileLOD> FileLODs;
+
+	UPROPERTY()
+	FUnrealSTLStaticMeshConfig StaticMeshConfig;
+
+	UPROPERTY()
+	UStaticMesh* StaticMesh;
+
+	/** parsed sections (one array per LOD), kept around for rebuilding the StaticMesh */
+	TArray<TArray<FUnrealSTLMesh>> STLMeshLODs;
+	TArray<TArray<FWatchedFile>> WatchedFileLODs;
+
+	float TimeSinceLastPoll;
+
+#if ENGINE_MAJOR_VERSION > 4
+	FTSTicker::FDelegateHandle TickerHandle;
+#else
+	FDelegateHandle TickerHandle;
+#endif
+};
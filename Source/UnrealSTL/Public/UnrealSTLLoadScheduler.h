@@ -0,0 +1,84 @@
+// Copyright 2022, Roberto De Ioris.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UnrealSTLFunctionLibrary.h"
+#include "UnrealSTLLoadScheduler.generated.h"
+
+DECLARE_DYNAMIC_DELEGATE_OneParam(FUnrealSTLLoadCompleted, UStaticMesh*, StaticMesh);
+
+USTRUCT()
+struct FUnrealSTLScheduledLoad
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FUnrealSTLFileLOD> FileLODs;
+
+	UPROPERTY()
+	FUnrealSTLStaticMeshConfig StaticMeshConfig;
+
+	UPROPERTY()
+	FUnrealSTLLoadCompleted OnCompleted;
+
+	int64 EstimatedMemory;
+	int32 LoadId;
+	/** EstimatedMemory is known */
+	bool bProbed;
+
+	FUnrealSTLScheduledLoad()
+	{
+		EstimatedMemory = 0;
+		LoadId = 0;
+		bProbed = false;
+	}
+};
+
+/**
+ * Runs loads in the background, admitting them (in order) only when their estimated memory
+ * (from ProbeSTLFile, run in the background too) fits in the MemoryBudget together with the already running ones.
+ * A load bigger than the whole budget is run alone.
+ */
+UCLASS(BlueprintType)
+class UNREALSTL_API UUnrealSTLLoadScheduler : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UUnrealSTLLoadScheduler();
+
+	UFUNCTION(BlueprintCallable, Category = "UnrealSTL")
+	static UUnrealSTLLoadScheduler* CreateSTLLoadScheduler(const int64 MemoryBudget);
+
+	/** Returns false if there are no files, OnCompleted is called on the game thread (with nullptr on failure, including failed probes) */
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "StaticMeshConfig"), Category = "UnrealSTL")
+	bool EnqueueLoad(const TArray<FUnrealSTLFileLOD>& FileLODs, const FUnrealSTLStaticMeshConfig& StaticMeshConfig, const FUnrealSTLLoadCompleted& OnCompleted);
+
+	UFUNCTION(BlueprintPure, Category = "UnrealSTL")
+	int64 GetMemoryInUse() const;
+
+	UFUNCTION(BlueprintPure, Category = "UnrealSTL")
+	int32 GetPendingLoadsNum() const;
+
+	UFUNCTION(BlueprintPure, Category = "UnrealSTL")
+	int32 GetRunningLoadsNum() const;
+
+	/** CPU + GPU memory (in bytes) available for concurrent loads */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UnrealSTL")
+	int64 MemoryBudget;
+
+protected:
+	void Pump();
+	void Probed(const int32 LoadId, const int64 EstimatedMemory, const bool bSuccess);
+	void Complete(const int32 LoadId, TArray<TArray<FUnrealSTLMesh>>&& STLMeshLODs, const bool bSuccess);
+
+	UPROPERTY()
+	TArray<FUnrealSTLScheduledLoad> PendingLoads;
+
+	UPROPERTY()
+	TArray<FUnrealSTLScheduledLoad> RunningLoads;
+
+	int64 MemoryInUse;
+	int32 NextLoadId;
+};
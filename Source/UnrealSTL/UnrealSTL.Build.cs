@@ -25,5 +25,8 @@ public class UnrealSTL : ModuleRules
                 "RHI"
             }
             );
+
+        // streaming decompression of .stl.gz files
+        AddEngineThirdPartyPrivateStaticDependencies(Target, "zlib");
     }
 }
@@ -1,15 +1,113 @@
 // Copyright 2022, Roberto De Ioris.
 
 #include "UnrealSTLEditor.h"
+#include "DesktopPlatformModule.h"
+#include "Editor.h"
+#include "Engine/Selection.h"
+#include "Framework/Application/SlateApplication.h"
+#include "IDesktopPlatform.h"
+#include "Misc/MessageDialog.h"
+#include "ToolMenus.h"
+#include "UnrealSTLFunctionLibrary.h"
 
 #define LOCTEXT_NAMESPACE "FUnrealSTLEditorModule"
 
 void FUnrealSTLEditorModule::StartupModule()
 {
+	UToolMenus::RegisterStartupCallback(FSimpleMulticastDelegate::FDelegate::CreateRaw(this, &FUnrealSTLEditorModule::RegisterMenus));
 }
 
 void FUnrealSTLEditorModule::ShutdownModule()
 {
+	UToolMenus::UnRegisterStartupCallback(this);
+	UToolMenus::UnregisterOwner(this);
+}
+
+void FUnrealSTLEditorModule::RegisterMenus()
+{
+	FToolMenuOwnerScoped OwnerScoped(this);
+
+	UToolMenu* Menu = UToolMenus::Get()->ExtendMenu("LevelEditor.MainMenu.File");
+	FToolMenuSection& Section = Menu->AddSection("UnrealSTL", LOCTEXT("UnrealSTLSection", "STL"));
+
+	Section.AddMenuEntry("ExportSelectedActorsToSTL",
+		LOCTEXT("ExportSelectedActorsToSTL", "Export Selected Actors to STL..."),
+		LOCTEXT("ExportSelectedActorsToSTLTooltip", "Export the StaticMeshes of the selected Actors in a single STL file"),
+		FSlateIcon(),
+		FUIAction(FExecuteAction::CreateRaw(this, &FUnrealSTLEditorModule::ExportSelectedActors)));
+
+	Section.AddMenuEntry("ExportLevelToSTL",
+		LOCTEXT("ExportLevelToSTL", "Export Level to STL..."),
+		LOCTEXT("ExportLevelToSTLTooltip", "Export the StaticMeshes of the current Level in a single STL file"),
+		FSlateIcon(),
+		FUIAction(FExecuteAction::CreateRaw(this, &FUnrealSTLEditorModule::ExportLevel)));
+}
+
+bool FUnrealSTLEditorModule::GetExportFilename(FString& Filename) const
+{
+	IDesktopPlatform* DesktopPlatform = FDesktopPlatformModule::Get();
+	if (!DesktopPlatform)
+	{
+		return false;
+	}
+
+	TArray<FString> Filenames;
+	if (!DesktopPlatform->SaveFileDialog(FSlateApplication::Get().FindBestParentWindowHandleForDialogs(nullptr),
+		LOCTEXT("ExportToSTLTitle", "Export to STL").ToString(),
+		TEXT(""), TEXT("Scene.stl"),
+		TEXT("STL file|*.stl|Gzip compressed STL file|*.stl.gz"),
+		EFileDialogFlags::None, Filenames) || Filenames.Num() < 1)
+	{
+		return false;
+	}
+
+	Filename = Filenames[0];
+	return true;
+}
+
+void FUnrealSTLEditorModule::ExportSelectedActors()
+{
+	TArray<UStaticMeshComponent*> Components;
+	for (FSelectionIterator It(GEditor->GetSelectedActorIterator()); It; ++It)
+	{
+		if (AActor* Actor = Cast<AActor>(*It))
+		{
+			TArray<UStaticMeshComponent*> ActorComponents;
+			Actor->GetComponents(ActorComponents);
+			Components.Append(ActorComponents);
+		}
+	}
+
+	if (Components.Num() < 1)
+	{
+		FMessageDialog::Open(EAppMsgType::Ok, LOCTEXT("NoStaticMeshesSelected", "The selected Actors have no StaticMeshComponents"));
+		return;
+	}
+
+	FString Filename;
+	if (!GetExportFilename(Filename))
+	{
+		return;
+	}
+
+	if (!UUnrealSTLFunctionLibrary::SaveStaticMeshComponentsToSTLFile(Components, 0, Filename, FUnrealSTLConfig()))
+	{
+		FMessageDialog::Open(EAppMsgType::Ok, FText::Format(LOCTEXT("ExportFailed", "Unable to export to {0}"), FText::FromString(Filename)));
+	}
+}
+
+void FUnrealSTLEditorModule::ExportLevel()
+{
+	FString Filename;
+	if (!GetExportFilename(Filename))
+	{
+		return;
+	}
+
+	if (!UUnrealSTLFunctionLibrary::SaveWorldToSTLFile(GEditor->GetEditorWorldContext().World(), 0, Filename, FUnrealSTLConfig()))
+	{
+		FMessageDialog::Open(EAppMsgType::Ok, FText::Format(LOCTEXT("ExportFailed", "Unable to export to {0}"), FText::FromString(Filename)));
+	}
 }
 
 #undef LOCTEXT_NAMESPACE
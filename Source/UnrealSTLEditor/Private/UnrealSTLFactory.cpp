@@ -4,29 +4,168 @@
 #include "UnrealSTLFactory.h"
 #include "StaticMeshDescription.h"
 #include "StaticMeshAttributes.h"
+#include "Misc/SecureHash.h"
 #include "UnrealSTLFunctionLibrary.h"
+#include "UnrealSTLAssetUserData.h"
+#include "Framework/Application/SlateApplication.h"
+#include "Framework/Docking/TabManager.h"
+#include "IDetailsView.h"
+#include "Misc/App.h"
+#include "PropertyEditorModule.h"
+#include "Widgets/Input/SButton.h"
+#include "Widgets/Layout/SBox.h"
+#include "Widgets/SBoxPanel.h"
+#include "Widgets/SWindow.h"
+
+#define LOCTEXT_NAMESPACE "UnrealSTLFactory"
 
 UUnrealSTLFactory::UUnrealSTLFactory(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 {
 	SupportedClass = UStaticMesh::StaticClass();
 	Formats.Add(TEXT("stl;STL file"));
+	Formats.Add(TEXT("gz;Gzip compressed STL file"));
+	Formats.Add(TEXT("zip;Zip compressed STL file"));
 	bEditorImport = true;
+	bCleanupFacets = false;
+	bEnableNanite = false;
+	NaniteFallbackPercentTriangles = 100.0f;
+	NaniteFallbackRelativeError = 1.0f;
+	bImportAll = false;
+}
+
+bool UUnrealSTLFactory::FactoryCanImport(const FString& Filename)
+{
+	// do not claim every .gz/.zip file
+	if (FPaths::GetExtension(Filename).Equals(TEXT("gz"), ESearchCase::IgnoreCase))
+	{
+		return Filename.EndsWith(TEXT(".stl.gz"), ESearchCase::IgnoreCase);
+	}
+
+	if (FPaths::GetExtension(Filename).Equals(TEXT("zip"), ESearchCase::IgnoreCase))
+	{
+		return Filename.EndsWith(TEXT(".stl.zip"), ESearchCase::IgnoreCase);
+	}
+
+	return true;
+}
+
+void UUnrealSTLFactory::CleanUp()
+{
+	Super::CleanUp();
+	bImportAll = false;
+}
+
+bool UUnrealSTLFactory::ShowImportOptions()
+{
+	bool bImport = false;
+
+	TSharedRef<SWindow> Window = SNew(SWindow)
+		.Title(LOCTEXT("ImportOptionsTitle", "STL Import Options"))
+		.SizingRule(ESizingRule::Autosized);
+
+	FPropertyEditorModule& PropertyEditorModule = FModuleManager::LoadModuleChecked<FPropertyEditorModule>("PropertyEditor");
+	FDetailsViewArgs DetailsViewArgs;
+	DetailsViewArgs.bAllowSearch = false;
+	DetailsViewArgs.NameAreaSettings = FDetailsViewArgs::HideNameArea;
+	TSharedRef<IDetailsView> DetailsView = PropertyEditorModule.CreateDetailView(DetailsViewArgs);
+	DetailsView->SetObject(this);
+
+	auto CloseWindow = [&Window, &bImport](const bool bInImport)
+	{
+		bImport = bInImport;
+		Window->RequestDestroyWindow();
+		return FReply::Handled();
+	};
+
+	Window->SetContent(
+		SNew(SBox)
+		.WidthOverride(400.0f)
+		[
+			SNew(SVerticalBox)
+			+ SVerticalBox::Slot()
+			.AutoHeight()
+			.Padding(2.0f)
+			[
+				DetailsView
+			]
+			+ SVerticalBox::Slot()
+			.AutoHeight()
+			.HAlign(HAlign_Right)
+			.Padding(2.0f)
+			[
+				SNew(SHorizontalBox)
+				+ SHorizontalBox::Slot()
+				.AutoWidth()
+				.Padding(2.0f)
+				[
+					SNew(SButton)
+					.Text(LOCTEXT("ImportAll", "Import All"))
+					.OnClicked_Lambda([this, &CloseWindow]() { bImportAll = true; return CloseWindow(true); })
+				]
+				+ SHorizontalBox::Slot()
+				.AutoWidth()
+				.Padding(2.0f)
+				[
+					SNew(SButton)
+					.Text(LOCTEXT("Import", "Import"))
+					.OnClicked_Lambda([&CloseWindow]() { return CloseWindow(true); })
+				]
+				+ SHorizontalBox::Slot()
+				.AutoWidth()
+				.Padding(2.0f)
+				[
+					SNew(SButton)
+					.Text(LOCTEXT("Cancel", "Cancel"))
+					.OnClicked_Lambda([&CloseWindow]() { return CloseWindow(false); })
+				]
+			]
+		]);
+
+	FSlateApplication::Get().AddModalWindow(Window, FGlobalTabmanager::Get()->GetRootWindow());
+
+	return bImport;
 }
 
 UObject* UUnrealSTLFactory::FactoryCreateBinary(UClass* InClass, UObject* InParent, FName InName, EObjectFlags Flags, UObject* Context, const TCHAR* Type, const uint8*& Buffer, const uint8* BufferEnd, FFeedbackContext* Warn, bool& bOutOperationCanceled)
 {
+	// interactive imports ask for the options, automated (scripted or commandlet) ones use the properties as set
+	if (!IsAutomatedImport() && !FApp::IsUnattended() && !bImportAll && FSlateApplication::IsInitialized())
+	{
+		if (!ShowImportOptions())
+		{
+			bOutOperationCanceled = true;
+			return nullptr;
+		}
+	}
+
 	UStaticMesh* StaticMesh = NewObject<UStaticMesh>(InParent, InName, Flags);
 
 	FArrayReader Reader;
 	Reader.Append(Buffer, BufferEnd - Buffer);
 
+	FUnrealSTLConfig Config;
+	Config.bCleanupFacets = bCleanupFacets;
+
 	FUnrealSTLMesh STLMesh;
-	if (!UUnrealSTLFunctionLibrary::LoadMeshFromSTLData(Reader, FUnrealSTLConfig(), STLMesh))
+	if (!UUnrealSTLFunctionLibrary::LoadMeshFromSTLData(Reader, Config, STLMesh))
 	{
 		return nullptr;
 	}
 
+	// allows runtime loads to check that the asset matches the STL file
+	UUnrealSTLAssetUserData* UserData = NewObject<UUnrealSTLAssetUserData>(StaticMesh);
+	FSHAHash SourceHash;
+	FSHA1::HashBuffer(Buffer, BufferEnd - Buffer, SourceHash.Hash);
+	UserData->SourceHash = SourceHash.ToString();
+	UserData->Config = Config;
+	StaticMesh->AddAssetUserData(UserData);
+
+	if (bCleanupFacets && Warn)
+	{
+		Warn->Logf(TEXT("STL cleanup: %u degenerate, %u duplicate and %u invalid facets removed, %u normals repaired"), STLMesh.DegenerateFacetsNum, STLMesh.DuplicateFacetsNum, STLMesh.InvalidFacetsNum, STLMesh.RepairedNormalsNum);
+	}
+
 	UStaticMeshDescription* MeshDescription = UStaticMesh::CreateStaticMeshDescription();
 
 	TVertexAttributesRef<FVector3f> Positions = MeshDescription->GetVertexPositions();
@@ -70,7 +209,47 @@ UObject* UUnrealSTLFactory::FactoryCreateBinary(UClass* InClass, UObject* InPare
 		MeshDescription->CreatePolygon(PolygonGroup, Instances, Edges);
 	}
 
+#if ENGINE_MAJOR_VERSION > 4
+	if (bEnableNanite)
+	{
+		// Nanite data can only be generated by the full build pipeline (BuildFromStaticMeshDescriptions skips it)
+		FStaticMeshSourceModel& SourceModel = StaticMesh->AddSourceModel();
+		SourceModel.BuildSettings.bRecomputeNormals = false;
+		SourceModel.BuildSettings.bRecomputeTangents = true;
+		SourceModel.BuildSettings.bGenerateLightmapUVs = false;
+
+		StaticMesh->CreateMeshDescription(0, MoveTemp(MeshDescription->GetMeshDescription()));
+		StaticMesh->CommitMeshDescription(0);
+
+		StaticMesh->GetStaticMaterials().Add(FStaticMaterial(UMaterial::GetDefaultMaterial(MD_Surface)));
+
+#if ENGINE_MINOR_VERSION < 5
+		FMeshNaniteSettings& NaniteSettings = StaticMesh->NaniteSettings;
+#else
+		FMeshNaniteSettings NaniteSettings = StaticMesh->GetNaniteSettings();
+#endif
+		NaniteSettings.bEnabled = true;
+#if ENGINE_MINOR_VERSION > 0
+		NaniteSettings.FallbackPercentTriangles = NaniteFallbackPercentTriangles / 100.0f;
+		NaniteSettings.FallbackRelativeError = NaniteFallbackRelativeError;
+#else
+		NaniteSettings.PercentTriangles = NaniteFallbackPercentTriangles / 100.0f;
+#endif
+#if ENGINE_MINOR_VERSION >= 5
+		StaticMesh->SetNaniteSettings(NaniteSettings);
+#endif
+
+		// silent build, no slow task dialogs (works in commandlets and headless Linux editors)
+		StaticMesh->Build(true);
+		StaticMesh->PostEditChange();
+
+		return StaticMesh;
+	}
+#endif
+
 	StaticMesh->BuildFromStaticMeshDescriptions({ MeshDescription }, false);
 
 	return StaticMesh;
-}
\ No newline at end of file
+}
+
+#undef LOCTEXT_NAMESPACE
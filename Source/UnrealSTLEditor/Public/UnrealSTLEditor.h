@@ -12,4 +12,10 @@ public:
 	/** IModuleInterface implementation */
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
+
+private:
+	void RegisterMenus();
+	bool GetExportFilename(FString& Filename) const;
+	void ExportSelectedActors();
+	void ExportLevel();
 };
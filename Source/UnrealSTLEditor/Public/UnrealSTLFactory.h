@@ -14,5 +14,30 @@ class UNREALSTLEDITOR_API UUnrealSTLFactory : public UFactory
 {
     GENERATED_UCLASS_BODY()
 
+    virtual bool FactoryCanImport(const FString& Filename) override;
     virtual UObject* FactoryCreateBinary(UClass* InClass, UObject* InParent, FName InName, EObjectFlags Flags, UObject* Context, const TCHAR* Type, const uint8*& Buffer, const uint8* BufferEnd, FFeedbackContext* Warn, bool& bOutOperationCanceled) override;
+    virtual void CleanUp() override;
+
+    /** Discard degenerate, duplicated and invalid facets and fix broken normals */
+    UPROPERTY(EditAnywhere, Category = "Import")
+    bool bCleanupFacets;
+
+    /** Build Nanite data for the imported StaticMesh (ignored on UE4) */
+    UPROPERTY(EditAnywhere, Category = "Nanite")
+    bool bEnableNanite;
+
+    /** Percentage of triangles kept in the fallback mesh (used by non-Nanite renderers, collisions and STL export) */
+    UPROPERTY(EditAnywhere, Category = "Nanite", meta = (ClampMin = 0, ClampMax = 100))
+    float NaniteFallbackPercentTriangles;
+
+    /** Maximum relative error of the fallback mesh (0 means only NaniteFallbackPercentTriangles is used) */
+    UPROPERTY(EditAnywhere, Category = "Nanite", meta = (ClampMin = 0))
+    float NaniteFallbackRelativeError;
+
+private:
+    /** Shows the options of the factory in a modal window, returns false if the import has been canceled */
+    bool ShowImportOptions();
+
+    /** the options window is not shown again for the remaining files of the batch */
+    bool bImportAll;
 };
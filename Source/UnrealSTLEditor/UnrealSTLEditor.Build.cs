@@ -24,7 +24,12 @@ public class UnrealSTLEditor : ModuleRules
                 "UnrealSTL",
                 "UnrealEd",
                 "MeshDescription",
-                "StaticMeshDescription"
+                "StaticMeshDescription",
+                "ToolMenus",
+                "DesktopPlatform",
+                "Slate",
+                "SlateCore",
+                "PropertyEditor"
             }
             );
     }